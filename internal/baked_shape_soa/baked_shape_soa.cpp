@@ -0,0 +1 @@
+#include "baked_shape_soa.h"
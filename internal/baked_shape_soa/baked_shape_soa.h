@@ -0,0 +1,145 @@
+#pragma once
+#include <array>
+#include <utility>
+#include "shape_soa.h"
+
+
+#ifdef SOA
+
+// One entry of a constexpr scene description, the same arguments ShapeSoA::insert takes
+struct BakedPrimitive {
+        Shape shape;
+        glm::vec3 color;
+        float intensity;
+        MaterialHandle material{};
+        TextureHandle texture{};                // index into the scene's TextureCache in load order
+        TriangleUVs uvs = default_triangle_uvs; // only used by triangles
+};
+
+// Calls f(std::integral_constant<size_t, I>{}) for every I in [0, N), expanded at compile time
+template<size_t N, typename F>
+constexpr void unroll(F &&f) {
+        [&]<size_t... I>(std::index_sequence<I...>) {
+                (f(std::integral_constant<size_t, I>{}), ...);
+        }(std::make_index_sequence<N>{});
+}
+
+// Drop in replacement for ShapeSoA when the scene is known at compile time, e.g.
+//      static constexpr std::array<BakedPrimitive, 2> description{{{Circle({0, 1, 0}, 1), {255, 255, 255}, 10}, ...}};
+//      Scene<800, 800, BakedShapeSoA<description>> scene(...);
+// Every array is sized by the description, and the intersection and light loops are unrolled over them.
+// Meshes own heap buffers and cannot be baked, so the primitive arguments of the accessors are always 0.
+template<const auto &DESCRIPTION>
+class BakedShapeSoA : public ShapeAccessors<BakedShapeSoA<DESCRIPTION>> {
+private: // Private Member Functions
+        template<typename T>
+        static consteval size_t count() {
+                size_t total = 0;
+                for (const BakedPrimitive &primitive: DESCRIPTION)
+                        total += std::holds_alternative<T>(primitive.shape);
+                return total;
+        }
+        
+        // Index into DESCRIPTION of the n-th primitive holding a T
+        template<typename T>
+        static consteval size_t nth(size_t n) {
+                for (size_t i = 0; i < DESCRIPTION.size(); i++)
+                        if (std::holds_alternative<T>(DESCRIPTION[i].shape) && n-- == 0)
+                                return i;
+                return DESCRIPTION.size();
+        }
+        
+        template<typename T, typename F>
+        static consteval auto gather(F field) {
+                return [&]<size_t... I>(std::index_sequence<I...>) {
+                        return std::array<decltype(field(DESCRIPTION[0])), sizeof...(I)>{field(DESCRIPTION[nth<T>(I)])...};
+                }(std::make_index_sequence<count<T>()>{});
+        }
+        
+        template<typename T>
+        static consteval auto gather_shapes() {
+                return gather<T>([](const BakedPrimitive &primitive) { return std::get<T>(primitive.shape); });
+        }
+        template<typename T>
+        static consteval auto gather_colors() {
+                return gather<T>([](const BakedPrimitive &primitive) { return primitive.color; });
+        }
+        template<typename T>
+        static consteval auto gather_intensities() {
+                return gather<T>([](const BakedPrimitive &primitive) { return primitive.intensity; });
+        }
+        template<typename T>
+        static consteval auto gather_materials() {
+                return gather<T>([](const BakedPrimitive &primitive) { return primitive.material; });
+        }
+        template<typename T>
+        static consteval auto gather_textures() {
+                return gather<T>([](const BakedPrimitive &primitive) { return primitive.texture; });
+        }
+        
+        static consteval size_t circle_light_count() {
+                size_t total = 0;
+                for (const BakedPrimitive &primitive: DESCRIPTION)
+                        total += std::holds_alternative<Circle>(primitive.shape) && primitive.intensity > 0;
+                return total;
+        }
+        static consteval auto gather_circle_lights() {
+                std::array<uint32_t, circle_light_count()> light_indices{};
+                for (uint32_t i = 0, light = 0; i < count<Circle>(); i++)
+                        if (DESCRIPTION[nth<Circle>(i)].intensity > 0)
+                                light_indices[light++] = i;
+                return light_indices;
+        }
+        
+        static std::array<glm::vec3, count<Triangle>()> calculate_triangle_normals() {
+                std::array<glm::vec3, count<Triangle>()> normals{};
+                for (size_t i = 0; i < normals.size(); i++)
+                        normals[i] = triangles[i].calculate_normal();
+                return normals;
+        }
+public:
+        static constexpr std::array circles = gather_shapes<Circle>();
+        static constexpr std::array triangles = gather_shapes<Triangle>();
+        static constexpr std::array planes = gather_shapes<Plane>();
+        
+        static constexpr std::array m_circle_colors = gather_colors<Circle>();
+        static constexpr std::array m_triangle_colors = gather_colors<Triangle>();
+        static constexpr std::array m_plane_colors = gather_colors<Plane>();
+        static inline const std::array m_triangle_normals = calculate_triangle_normals(); // glm::normalize is not constexpr
+        
+        static constexpr std::array m_circle_intensities = gather_intensities<Circle>();
+        static constexpr std::array m_triangle_intensities = gather_intensities<Triangle>();
+        static constexpr std::array m_plane_intensities = gather_intensities<Plane>();
+        
+        static constexpr std::array m_circle_materials = gather_materials<Circle>();
+        static constexpr std::array m_triangle_materials = gather_materials<Triangle>();
+        static constexpr std::array m_plane_materials = gather_materials<Plane>();
+        
+        static constexpr std::array m_circle_textures = gather_textures<Circle>();
+        static constexpr std::array m_triangle_textures = gather_textures<Triangle>();
+        static constexpr std::array m_plane_textures = gather_textures<Plane>();
+        static constexpr std::array m_triangle_uvs = gather<Triangle>([](const BakedPrimitive &primitive) { return primitive.uvs; });
+        
+        static constexpr std::array m_circle_light_indices = gather_circle_lights();
+        
+        template<typename F>
+        void for_each_circle_light(F &&f) const {
+                unroll<m_circle_light_indices.size()>([&](auto i) {
+                        f(m_circle_light_indices[i], circles[m_circle_light_indices[i]]);
+                });
+        }
+        
+        HitBuffer intersect_all(const Ray &ray) const {
+                HitBuffer closest{.index = 0, .distance = std::numeric_limits<float>::max(), .shape_type = ShapeType::Circle};
+                glm::vec2 barycentrics{};
+                auto closest_of = [&](float intersection_dist, size_t index, ShapeType shape_type) {
+                        if (intersection_dist > 0.001 && intersection_dist < closest.distance)
+                                closest = {.index = index, .distance = intersection_dist, .shape_type = shape_type, .barycentrics = barycentrics};
+                };
+                unroll<circles.size()>([&](auto i) { closest_of(circles[i].intersect(ray), i, ShapeType::Circle); });
+                unroll<triangles.size()>([&](auto i) { closest_of(triangles[i].intersect(ray, barycentrics), i, ShapeType::Triangle); });
+                unroll<planes.size()>([&](auto i) { closest_of(planes[i].intersect(ray), i, ShapeType::Plane); });
+                return closest;
+        }
+};
+#endif
@@ -32,3 +32,28 @@ void Camera::translate(glm::vec3 offset) noexcept {
 Ray Camera::get_ray(glm::vec2 uv) {
         return Ray(m_origin, {glm::normalize(m_lower_left_corner + uv.x * m_horizontal + uv.y * m_vertical - m_origin)});
 }
+
+RayCone Camera::pixel_cone(uint32_t resolution_y) const noexcept {
+        return RayCone{.width = 0.0f, .spread = glm::length(m_vertical) / float(resolution_y)}; // The viewport sits one unit in front of the origin
+}
+
+CameraConnection Camera::connect(glm::vec3 point) const noexcept {
+        glm::vec3 forward = glm::normalize(glm::cross(m_vertical, m_horizontal));
+        glm::vec3 offset = point - m_origin;
+        float distance = glm::length(offset);
+        glm::vec3 direction = offset / distance;
+        float cos_theta = glm::dot(direction, forward);
+        float film_distance = glm::dot(m_lower_left_corner - m_origin, forward);
+        if (cos_theta <= 0.0f || distance <= 0.0f)
+                return CameraConnection{.uv = glm::vec2{0}, .direction = -direction, .distance = distance, .importance = 0.0f};
+        
+        glm::vec3 film = m_origin + direction * (film_distance / cos_theta) - m_lower_left_corner;
+        glm::vec2 uv{glm::dot(film, m_horizontal) / glm::dot(m_horizontal, m_horizontal), glm::dot(film, m_vertical) / glm::dot(m_vertical, m_vertical)};
+        if (uv.x < 0.0f || uv.x >= 1.0f || uv.y < 0.0f || uv.y >= 1.0f)
+                return CameraConnection{.uv = uv, .direction = -direction, .distance = distance, .importance = 0.0f};
+        
+        // Film area per solid angle is film_distance^2 / cos^3, and solid angle per area at the point is 1 / distance^2
+        float film_area = glm::length(m_horizontal) * glm::length(m_vertical);
+        float importance = film_distance * film_distance / (film_area * cos_theta * cos_theta * cos_theta * distance * distance);
+        return CameraConnection{.uv = uv, .direction = -direction, .distance = distance, .importance = importance};
+}
@@ -1,6 +1,16 @@
 #pragma once
 #include "ray.h"
 
+// Path from a world point to the camera, the inverse of get_ray. A light path vertex seen by the camera adds its
+// radiance towards it times importance to the pixel at uv, divided by the number of light paths traced per pixel.
+// importance is 0 when the point is behind the camera or outside its view.
+struct CameraConnection {
+        glm::vec2 uv;        // film coordinates as taken by get_ray
+        glm::vec3 direction; // from the point towards the camera
+        float distance;
+        float importance;
+};
+
 class Camera {
 public:  // Public Constructors/Destructors/Overloads
         Camera(glm::vec3 origin, glm::vec3 look_direction, glm::vec3 up_direction, float vertical_fov, float aspect_ratio);
@@ -9,6 +19,8 @@ public:  // Public Member Functions
         void translate(glm::vec3 offset) noexcept;
         
         Ray get_ray(glm::vec2 uv);
+        [[nodiscard]] RayCone pixel_cone(uint32_t resolution_y) const noexcept;
+        [[nodiscard]] CameraConnection connect(glm::vec3 point) const noexcept;
 public:  // Public Member Variables
 private: // Private Member Functions
 private: // Private Member Variables
@@ -0,0 +1,129 @@
+#include "environment.h"
+#include <algorithm>
+#include <iostream>
+#include <numbers>
+#include "stb_image.h"
+#include "raytracer_random.h"
+
+AliasTable::AliasTable(std::span<const float> weights) : m_bins(weights.size()) {
+        for (float weight: weights)
+                m_total += weight;
+        
+        auto count = float(weights.size());
+        if (m_total <= 0.0f) { // Nothing to importance sample, fall back to uniform so sample() still returns a valid index
+                for (uint32_t i = 0; i < m_bins.size(); i++)
+                        m_bins[i] = {.threshold = 1.0f, .alias = i, .pmf = 1.0f / count};
+                return;
+        }
+        
+        // Vose's method, bins below the average are topped up with the excess of one above it
+        std::vector<float> scaled(weights.size());
+        std::vector<uint32_t> small, large;
+        for (uint32_t i = 0; i < weights.size(); i++) {
+                m_bins[i].pmf = weights[i] / m_total;
+                scaled[i] = m_bins[i].pmf * count;
+                (scaled[i] < 1.0f ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+                uint32_t under = small.back();
+                uint32_t over = large.back();
+                small.pop_back();
+                m_bins[under].threshold = scaled[under];
+                m_bins[under].alias = over;
+                scaled[over] -= 1.0f - scaled[under];
+                if (scaled[over] < 1.0f) {
+                        large.pop_back();
+                        small.push_back(over);
+                }
+        }
+        // Whatever is left is 1 up to rounding error
+        for (uint32_t i: small)
+                m_bins[i] = {.threshold = 1.0f, .alias = i, .pmf = m_bins[i].pmf};
+        for (uint32_t i: large)
+                m_bins[i] = {.threshold = 1.0f, .alias = i, .pmf = m_bins[i].pmf};
+}
+
+uint32_t AliasTable::sample(float u) const noexcept {
+        float scaled = u * float(m_bins.size());
+        uint32_t index = std::min(uint32_t(scaled), uint32_t(m_bins.size() - 1));
+        return scaled - float(index) < m_bins[index].threshold ? index : m_bins[index].alias;
+}
+
+bool Environment::load(const char *filepath, float intensity) {
+        int width, height, channels;
+        float *pixels = stbi_loadf(filepath, &width, &height, &channels, 3);
+        if (pixels == nullptr) {
+                std::cerr << "Failed to load environment " << filepath << ": " << stbi_failure_reason() << "\n";
+                return false;
+        }
+        
+        // stb_image hands the rows over bottom first
+        std::vector<glm::vec3> texels(size_t(width) * height);
+        for (int y = 0; y < height; y++)
+                for (int x = 0; x < width; x++)
+                        texels[size_t(y) * width + x] = glm::vec3{pixels[(size_t(height - 1 - y) * width + x) * 3 + 0], pixels[(size_t(height - 1 - y) * width + x) * 3 + 1], pixels[(size_t(height - 1 - y) * width + x) * 3 + 2]};
+        stbi_image_free(pixels);
+        
+        set(std::move(texels), width, height, intensity);
+        return true;
+}
+
+void Environment::set(std::vector<glm::vec3> texels, uint32_t width, uint32_t height, float intensity) {
+        m_texels = std::move(texels);
+        m_width = width;
+        m_height = height;
+        
+        std::vector<float> row_weights(height);
+        std::vector<float> weights(width);
+        m_columns.clear();
+        m_columns.reserve(height);
+        for (uint32_t y = 0; y < height; y++) {
+                float sin_theta = sinf(std::numbers::pi_v<float> * (float(y) + 0.5f) / float(height));
+                for (uint32_t x = 0; x < width; x++) {
+                        glm::vec3 &color = m_texels[y * width + x];
+                        color = glm::max(color * intensity, glm::vec3{0}); // Negative radiance from broken files would break the pdf
+                        weights[x] = glm::dot(color, glm::vec3{0.2126f, 0.7152f, 0.0722f}) * sin_theta;
+                }
+                m_columns.emplace_back(weights);
+                row_weights[y] = m_columns.back().total();
+        }
+        m_rows = AliasTable(row_weights);
+}
+
+glm::uvec2 Environment::texel(glm::vec3 direction) const noexcept {
+        direction = glm::normalize(direction);
+        float u = atan2f(direction.x, -direction.z) * std::numbers::inv_pi_v<float> * 0.5f + 0.5f;
+        float v = acosf(glm::clamp(direction.y, -1.0f, 1.0f)) * std::numbers::inv_pi_v<float>;
+        return {std::min(uint32_t(u * float(m_width)), m_width - 1), std::min(uint32_t(v * float(m_height)), m_height - 1)};
+}
+
+glm::vec3 Environment::radiance(glm::vec3 direction) const noexcept {
+        glm::uvec2 coordinate = texel(direction);
+        return m_texels[coordinate.y * m_width + coordinate.x];
+}
+
+// Texels are constant over their patch of the image, so the image space density is pmf * texel count and the
+// equirectangular mapping adds the 1 / (2 pi^2 sin(theta)) Jacobian
+float Environment::pdf(glm::uvec2 coordinate, float sin_theta) const noexcept {
+        if (sin_theta <= 0.0f || m_rows.total() <= 0.0f)
+                return 0.0f;
+        float image_pdf = m_rows.pmf(coordinate.y) * m_columns[coordinate.y].pmf(coordinate.x) * float(m_width) * float(m_height);
+        return image_pdf / (2.0f * std::numbers::pi_v<float> * std::numbers::pi_v<float> * sin_theta);
+}
+
+float Environment::pdf(glm::vec3 direction) const noexcept {
+        float cos_theta = glm::clamp(glm::normalize(direction).y, -1.0f, 1.0f);
+        return pdf(texel(direction), sqrtf(1.0f - cos_theta * cos_theta));
+}
+
+LightSample Environment::sample(uint32_t &seed) const noexcept {
+        uint32_t y = m_rows.sample(random_pcg(seed));
+        uint32_t x = m_columns[y].sample(random_pcg(seed));
+        
+        // Uniform within the texel
+        float phi = ((float(x) + random_pcg(seed)) / float(m_width) - 0.5f) * 2.0f * std::numbers::pi_v<float>;
+        float theta = (float(y) + random_pcg(seed)) / float(m_height) * std::numbers::pi_v<float>;
+        float sin_theta = sinf(theta);
+        glm::vec3 direction{sin_theta * sinf(phi), cosf(theta), -sin_theta * cosf(phi)};
+        return {.direction = direction, .distance = std::numeric_limits<float>::infinity(), .pdf = pdf({x, y}, sin_theta)};
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+#include "shape.h"
+
+// Walker/Vose alias table, draws an index proportional to its weight in O(1). Each bin keeps its own probability next
+// to the threshold and alias so a sample and its pdf only touch one cache line.
+class AliasTable {
+public:  // Public Constructors/Destructors/Overloads
+        AliasTable() = default;
+        explicit AliasTable(std::span<const float> weights);
+public:  // Public Member Functions
+        // u in [0, 1), the remainder left after choosing the bin decides between it and its alias
+        [[nodiscard]] uint32_t sample(float u) const noexcept;
+        [[nodiscard]] float pmf(uint32_t index) const noexcept { return m_bins[index].pmf; }
+        [[nodiscard]] float total() const noexcept { return m_total; }
+        [[nodiscard]] size_t size() const noexcept { return m_bins.size(); }
+public:  // Public Member Variables
+private: // Private Member Functions
+private: // Private Member Variables
+        struct Bin {
+                float threshold;
+                uint32_t alias;
+                float pmf;
+        };
+        std::vector<Bin> m_bins;
+        float m_total = 0.0f;
+};
+
+// Equirectangular HDR environment seen by every ray that leaves the scene. +Y is up and the centre of the image looks
+// down -Z. Directions are importance sampled by luminance through a marginal alias table over the rows and one
+// conditional table per row, both weighted by sin(theta) so the pdf accounts for the compressed poles.
+class Environment {
+public:  // Public Member Functions
+        // Loads a Radiance .hdr (or any format stb_image can widen to float), returns false and keeps the old map on failure
+        bool load(const char *filepath, float intensity = 1.0f);
+        // Texels are linear RGB radiance, top row first
+        void set(std::vector<glm::vec3> texels, uint32_t width, uint32_t height, float intensity = 1.0f);
+        
+        [[nodiscard]] bool valid() const noexcept { return !m_texels.empty(); }
+        [[nodiscard]] glm::vec3 radiance(glm::vec3 direction) const noexcept;
+        
+        // distance is infinite, pdf is per solid angle and 0 for directions carrying no light
+        [[nodiscard]] LightSample sample(uint32_t &seed) const noexcept;
+        [[nodiscard]] float pdf(glm::vec3 direction) const noexcept;
+public:  // Public Member Variables
+private: // Private Member Functions
+        [[nodiscard]] glm::uvec2 texel(glm::vec3 direction) const noexcept;
+        [[nodiscard]] float pdf(glm::uvec2 texel, float sin_theta) const noexcept;
+private: // Private Member Variables
+        std::vector<glm::vec3> m_texels;
+        uint32_t m_width = 0;
+        uint32_t m_height = 0;
+        
+        AliasTable m_rows;                 // marginal, picks a row
+        std::vector<AliasTable> m_columns; // conditional, picks a texel within each row
+};
@@ -0,0 +1,70 @@
+#include "frozen_shape_soa.h"
+#include <algorithm>
+#include <new>
+
+#ifdef SOA
+FrozenShapeSoA::FrozenShapeSoA(const ShapeSoA &shapes) {
+        // Run once to measure the block and once more to copy into it
+        std::vector<MeshView> mesh_views(shapes.meshes.size());
+        std::byte *block = nullptr;
+        size_t offset = 0;
+        auto place = [&](const auto &source, auto &destination) {
+                using T = typename std::remove_cvref_t<decltype(source)>::value_type;
+                static_assert(std::is_trivially_copyable_v<T>);
+                offset = (offset + cache_line_size - 1) / cache_line_size * cache_line_size;
+                if (block != nullptr) {
+                        T *first = reinterpret_cast<T *>(block + offset);
+                        std::uninitialized_copy(source.begin(), source.end(), first);
+                        destination = std::span<const T>(first, source.size());
+                }
+                offset += source.size() * sizeof(T);
+        };
+        auto place_all = [&] {
+                // Read by every intersect_all call
+                place(shapes.circles, circles);
+                place(shapes.triangles, triangles);
+                place(shapes.planes, planes);
+                for (size_t i = 0; i < shapes.meshes.size(); i++) {
+                        MeshView source = shapes.meshes[i].view();
+                        MeshView &view = mesh_views[i];
+                        place(source.indices, view.indices);
+                        place(source.quantized_positions, view.quantized_positions);
+                        place(source.positions, view.positions);
+                        place(source.uvs, view.uvs);
+                        view.bounds_min = source.bounds_min;
+                        view.bounds_max = source.bounds_max;
+                        view.quantization_step = source.quantization_step;
+                }
+                place(mesh_views, meshes);
+                // Read once per hit or light sample
+                place(shapes.m_circle_light_indices, m_circle_light_indices);
+                place(shapes.m_triangle_normals, m_triangle_normals);
+                place(shapes.m_circle_colors, m_circle_colors);
+                place(shapes.m_triangle_colors, m_triangle_colors);
+                place(shapes.m_plane_colors, m_plane_colors);
+                place(shapes.m_mesh_colors, m_mesh_colors);
+                place(shapes.m_circle_intensities, m_circle_intensities);
+                place(shapes.m_triangle_intensities, m_triangle_intensities);
+                place(shapes.m_plane_intensities, m_plane_intensities);
+                place(shapes.m_mesh_intensities, m_mesh_intensities);
+                place(shapes.m_circle_materials, m_circle_materials);
+                place(shapes.m_triangle_materials, m_triangle_materials);
+                place(shapes.m_plane_materials, m_plane_materials);
+                place(shapes.m_mesh_materials, m_mesh_materials);
+                place(shapes.m_circle_textures, m_circle_textures);
+                place(shapes.m_triangle_textures, m_triangle_textures);
+                place(shapes.m_plane_textures, m_plane_textures);
+                place(shapes.m_mesh_textures, m_mesh_textures);
+                place(shapes.m_triangle_uvs, m_triangle_uvs);
+                place(shapes.m_triangle_light_indices, m_triangle_light_indices);
+                place(shapes.m_plane_light_indices, m_plane_light_indices);
+        };
+        
+        place_all();
+        m_block_bytes = std::max(offset, cache_line_size);
+        block = static_cast<std::byte *>(::operator new(m_block_bytes, std::align_val_t{cache_line_size}));
+        m_block = std::shared_ptr<const std::byte>(block, [](const std::byte *bytes) { ::operator delete(const_cast<std::byte *>(bytes), std::align_val_t{cache_line_size}); });
+        offset = 0;
+        place_all();
+}
+#endif
@@ -0,0 +1,115 @@
+#pragma once
+#include <memory>
+#include <span>
+#include "shape_soa.h"
+
+class FrozenShapeSoA; // only defined in SOA builds
+
+#ifdef SOA
+
+static constexpr size_t cache_line_size = 64;
+
+// Immutable copy of a ShapeSoA laid out in one contiguous block, every array starting on its own cache line and the
+// arrays read by intersect_all placed first. Mesh vertex, index and uv buffers are copied into the block as well, with
+// one MeshView per mesh pointing at them, so nothing of the frozen scene lives outside it. Build the scene in a ShapeSoA, then
+//      Scene<800, 800, FrozenShapeSoA> scene(...);
+//      scene.m_shape_soa = FrozenShapeSoA(shapes);
+// Copies share the block, so one frozen scene can be handed to any number of workers without copying it again.
+class FrozenShapeSoA : public ShapeAccessors<FrozenShapeSoA> {
+public:  // Public Constructors/Destructors/Overloads
+        FrozenShapeSoA() = default;
+        explicit FrozenShapeSoA(const ShapeSoA &shapes);
+public:  // Public Member Functions
+        [[nodiscard]] size_t block_bytes() const noexcept { return m_block_bytes; }
+        
+        template<typename F>
+        void for_each_circle_light(F &&f) const {
+                for (uint32_t light_index: m_circle_light_indices)
+                        f(light_index, circles[light_index]);
+        }
+        
+        HitBuffer intersect_all(const Ray &ray) const {
+                float closest_intersection_distance = std::numeric_limits<float>::max();
+                size_t closest_shape_index = 0;
+                ShapeType closest_shape_type = ShapeType::Circle;
+                glm::vec2 closest_barycentrics{};
+                uint32_t closest_primitive = 0;
+                for (uint32_t i = 0; i < circles.size(); i++) {
+                        float intersection_dist = circles[i].intersect(ray);
+                        if (intersection_dist > 0.001 && intersection_dist < closest_intersection_distance) {
+                                closest_intersection_distance = intersection_dist;
+                                closest_shape_index = i;
+                                closest_shape_type = ShapeType::Circle;
+                        }
+                }
+                for (uint32_t i = 0; i < triangles.size(); i++) {
+                        glm::vec2 barycentrics;
+                        float intersection_dist = triangles[i].intersect(ray, barycentrics);
+                        if (intersection_dist > 0.001 && intersection_dist < closest_intersection_distance) {
+                                closest_intersection_distance = intersection_dist;
+                                closest_shape_index = i;
+                                closest_shape_type = ShapeType::Triangle;
+                                closest_barycentrics = barycentrics;
+                        }
+                }
+                for (uint32_t i = 0; i < planes.size(); i++) {
+                        float intersection_dist = planes[i].intersect(ray);
+                        if (intersection_dist > 0.001 && intersection_dist < closest_intersection_distance) {
+                                closest_intersection_distance = intersection_dist;
+                                closest_shape_index = i;
+                                closest_shape_type = ShapeType::Plane;
+                        }
+                }
+                for (uint32_t i = 0; i < meshes.size(); i++) {
+                        uint32_t primitive;
+                        glm::vec2 barycentrics;
+                        float intersection_dist = meshes[i].intersect(ray, closest_intersection_distance, primitive, barycentrics);
+                        if (intersection_dist < closest_intersection_distance) {
+                                closest_intersection_distance = intersection_dist;
+                                closest_shape_index = i;
+                                closest_shape_type = ShapeType::Mesh;
+                                closest_barycentrics = barycentrics;
+                                closest_primitive = primitive;
+                        }
+                }
+        
+                return {.index = closest_shape_index, .distance = closest_intersection_distance, .shape_type = closest_shape_type, .barycentrics = closest_barycentrics, .primitive = closest_primitive};
+        }
+public:  // Public Member Variables
+        // Views into the block, read only
+        std::span<const Circle> circles;
+        std::span<const Triangle> triangles;
+        std::span<const Plane> planes;
+        std::span<const MeshView> meshes;
+        
+        std::span<const glm::vec3> m_circle_colors;
+        std::span<const glm::vec3> m_triangle_colors;
+        std::span<const glm::vec3> m_plane_colors;
+        std::span<const glm::vec3> m_mesh_colors;
+        std::span<const glm::vec3> m_triangle_normals;
+        
+        std::span<const float> m_circle_intensities;
+        std::span<const float> m_triangle_intensities;
+        std::span<const float> m_plane_intensities;
+        std::span<const float> m_mesh_intensities;
+        
+        std::span<const MaterialHandle> m_circle_materials;
+        std::span<const MaterialHandle> m_triangle_materials;
+        std::span<const MaterialHandle> m_plane_materials;
+        std::span<const MaterialHandle> m_mesh_materials;
+        
+        std::span<const TextureHandle> m_circle_textures;
+        std::span<const TextureHandle> m_triangle_textures;
+        std::span<const TextureHandle> m_plane_textures;
+        std::span<const TextureHandle> m_mesh_textures;
+        std::span<const TriangleUVs> m_triangle_uvs;
+        
+        std::span<const uint32_t> m_circle_light_indices;
+        std::span<const uint32_t> m_triangle_light_indices;
+        std::span<const uint32_t> m_plane_light_indices;
+private: // Private Member Functions
+private: // Private Member Variables
+        std::shared_ptr<const std::byte> m_block;
+        size_t m_block_bytes = 0;
+};
+#endif
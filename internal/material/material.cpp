@@ -0,0 +1,177 @@
+#include "material.h"
+#include <numbers>
+#include "raytracer_random.h"
+
+static constexpr float pi = std::numbers::pi_v<float>;
+static constexpr float specular_alpha = 1e-3f; // below this GGX is numerically a mirror, so it is treated as one
+
+static BsdfSample absorbed() {
+        return BsdfSample{.direction = glm::vec3{0}, .weight = glm::vec3{0}, .pdf = 0.0f, .is_specular = false};
+}
+
+static float schlick(float f0, float cos_theta) {
+        float m = 1.0f - glm::clamp(cos_theta, 0.0f, 1.0f);
+        return f0 + (1.0f - f0) * m * m * m * m * m;
+}
+static glm::vec3 schlick(glm::vec3 f0, float cos_theta) {
+        float m = 1.0f - glm::clamp(cos_theta, 0.0f, 1.0f);
+        return f0 + (1.0f - f0) * (m * m * m * m * m);
+}
+
+static float ggx_d(float alpha, float cos_h) {
+        float a2 = alpha * alpha;
+        float d = cos_h * cos_h * (a2 - 1.0f) + 1.0f;
+        return a2 / (pi * d * d);
+}
+static float ggx_g1(float alpha, float cos_v) {
+        float a2 = alpha * alpha;
+        return 2.0f * cos_v / (cos_v + sqrtf(a2 + (1.0f - a2) * cos_v * cos_v));
+}
+static glm::vec3 ggx_sample_half_vector(uint32_t &seed, float alpha, glm::vec3 normal) {
+        float xi1 = random_pcg(seed);
+        float xi2 = random_pcg(seed);
+        float cos_theta = sqrtf((1.0f - xi1) / (1.0f + xi1 * (alpha * alpha - 1.0f)));
+        float sin_theta = sqrtf(glm::max(0.0f, 1.0f - cos_theta * cos_theta));
+        float phi = 2.0f * pi * xi2;
+        return tangent_to_world({cosf(phi) * sin_theta, sinf(phi) * sin_theta, cos_theta}, normal);
+}
+// pdf of reflecting wo about a GGX sampled half vector into wi, already converted to solid angle around wi
+static float ggx_reflection_pdf(float alpha, const SurfaceHit &hit, glm::vec3 wi) {
+        if (glm::dot(wi, hit.normal) <= 0.0f)
+                return 0.0f;
+        glm::vec3 h = glm::normalize(hit.wo + wi);
+        float cos_h = glm::max(glm::dot(h, hit.normal), 0.0f);
+        return ggx_d(alpha, cos_h) * cos_h / (4.0f * glm::max(glm::dot(hit.wo, h), 1e-6f));
+}
+// D * G / (4 * cos_o), the Fresnel-free part of f * cos for a GGX reflection
+static float ggx_reflection(float alpha, const SurfaceHit &hit, glm::vec3 wi) {
+        float cos_i = glm::dot(wi, hit.normal);
+        float cos_o = glm::dot(hit.wo, hit.normal);
+        if (cos_i <= 0.0f || cos_o <= 0.0f)
+                return 0.0f;
+        glm::vec3 h = glm::normalize(hit.wo + wi);
+        float cos_h = glm::max(glm::dot(h, hit.normal), 0.0f);
+        return ggx_d(alpha, cos_h) * ggx_g1(alpha, cos_i) * ggx_g1(alpha, cos_o) / (4.0f * cos_o);
+}
+
+
+BsdfSample Lambertian::sample_impl(uint32_t &seed, const SurfaceHit &hit) const noexcept {
+        glm::vec3 direction = hit.normal + random_unit_vector_pcg(seed);
+        direction = glm::length2(direction) > 1e-8f ? glm::normalize(direction) : hit.normal;
+        return BsdfSample{.direction = direction, .weight = hit.albedo, .pdf = pdf_impl(hit, direction), .is_specular = false};
+}
+glm::vec3 Lambertian::evaluate_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept {
+        return hit.albedo * glm::max(glm::dot(wi, hit.normal), 0.0f) / pi;
+}
+float Lambertian::pdf_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept {
+        return glm::max(glm::dot(wi, hit.normal), 0.0f) / pi;
+}
+
+
+Metal::Metal(float roughness) : m_alpha(roughness * roughness) {
+
+}
+BsdfSample Metal::sample_impl(uint32_t &seed, const SurfaceHit &hit) const noexcept {
+        float cos_o = glm::dot(hit.wo, hit.normal);
+        if (is_specular_impl()) {
+                glm::vec3 direction = glm::reflect(-hit.wo, hit.normal);
+                return BsdfSample{.direction = direction, .weight = schlick(hit.albedo, cos_o), .pdf = 0.0f, .is_specular = true};
+        }
+        
+        glm::vec3 h = ggx_sample_half_vector(seed, m_alpha, hit.normal);
+        glm::vec3 direction = glm::reflect(-hit.wo, h);
+        float cos_i = glm::dot(direction, hit.normal);
+        if (cos_i <= 0.0f || cos_o <= 0.0f)
+                return absorbed();
+        
+        // D cancels against the half vector pdf, leaving F * G * (wo.h) / (cos_o * cos_h)
+        float cos_h = glm::dot(h, hit.normal);
+        float o_dot_h = glm::dot(hit.wo, h);
+        glm::vec3 weight = schlick(hit.albedo, o_dot_h) * ggx_g1(m_alpha, cos_i) * ggx_g1(m_alpha, cos_o) * o_dot_h / (cos_o * cos_h);
+        return BsdfSample{.direction = direction, .weight = weight, .pdf = pdf_impl(hit, direction), .is_specular = false};
+}
+glm::vec3 Metal::evaluate_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept {
+        if (is_specular_impl())
+                return glm::vec3{0};
+        glm::vec3 h = glm::normalize(hit.wo + wi);
+        return schlick(hit.albedo, glm::dot(hit.wo, h)) * ggx_reflection(m_alpha, hit, wi);
+}
+float Metal::pdf_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept {
+        if (is_specular_impl())
+                return 0.0f;
+        return ggx_reflection_pdf(m_alpha, hit, wi);
+}
+bool Metal::is_specular_impl() const noexcept {
+        return m_alpha < specular_alpha;
+}
+
+
+Dielectric::Dielectric(float ior) : m_ior(ior) {
+
+}
+BsdfSample Dielectric::sample_impl(uint32_t &seed, const SurfaceHit &hit) const noexcept {
+        float eta = hit.front_face ? 1.0f / m_ior : m_ior;
+        float cos_i = glm::min(glm::dot(hit.wo, hit.normal), 1.0f);
+        float sin2_t = eta * eta * (1.0f - cos_i * cos_i);
+        
+        float r0 = (1.0f - m_ior) / (1.0f + m_ior);
+        float reflectance = sin2_t >= 1.0f ? 1.0f : schlick(r0 * r0, cos_i); // total internal reflection past the critical angle
+        
+        glm::vec3 direction;
+        if (random_pcg(seed) < reflectance)
+                direction = glm::reflect(-hit.wo, hit.normal);
+        else
+                direction = glm::normalize(-hit.wo * eta + hit.normal * (eta * cos_i - sqrtf(1.0f - sin2_t)));
+        return BsdfSample{.direction = direction, .weight = hit.albedo, .pdf = 0.0f, .is_specular = true};
+}
+glm::vec3 Dielectric::evaluate_impl(const SurfaceHit &, glm::vec3) const noexcept {
+        return glm::vec3{0};
+}
+float Dielectric::pdf_impl(const SurfaceHit &, glm::vec3) const noexcept {
+        return 0.0f;
+}
+
+
+Glossy::Glossy(float roughness, float ior) : m_alpha(glm::max(roughness * roughness, specular_alpha)) {
+        float r0 = (ior - 1.0f) / (ior + 1.0f);
+        m_f0 = r0 * r0;
+}
+float Glossy::specular_probability(const SurfaceHit &hit) const noexcept {
+        float fresnel = schlick(m_f0, glm::dot(hit.wo, hit.normal));
+        float diffuse = (1.0f - fresnel) * (hit.albedo.x + hit.albedo.y + hit.albedo.z) / 3.0f;
+        return glm::clamp(fresnel / (fresnel + diffuse + 1e-6f), 0.1f, 0.9f);
+}
+BsdfSample Glossy::sample_impl(uint32_t &seed, const SurfaceHit &hit) const noexcept {
+        glm::vec3 direction;
+        if (random_pcg(seed) < specular_probability(hit)) {
+                direction = glm::reflect(-hit.wo, ggx_sample_half_vector(seed, m_alpha, hit.normal));
+        } else {
+                direction = hit.normal + random_unit_vector_pcg(seed);
+                direction = glm::length2(direction) > 1e-8f ? glm::normalize(direction) : hit.normal;
+        }
+        
+        float pdf = pdf_impl(hit, direction);
+        if (pdf <= 0.0f)
+                return absorbed();
+        return BsdfSample{.direction = direction, .weight = evaluate_impl(hit, direction) / pdf, .pdf = pdf, .is_specular = false};
+}
+glm::vec3 Glossy::evaluate_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept {
+        float cos_i = glm::dot(wi, hit.normal);
+        if (cos_i <= 0.0f)
+                return glm::vec3{0};
+        glm::vec3 h = glm::normalize(hit.wo + wi);
+        float coat = schlick(m_f0, glm::dot(hit.wo, h)) * ggx_reflection(m_alpha, hit, wi);
+        float transmitted = 1.0f - schlick(m_f0, glm::dot(hit.wo, hit.normal));
+        return glm::vec3{coat} + transmitted * hit.albedo * cos_i / pi;
+}
+float Glossy::pdf_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept {
+        float p = specular_probability(hit);
+        return p * ggx_reflection_pdf(m_alpha, hit, wi) + (1.0f - p) * glm::max(glm::dot(wi, hit.normal), 0.0f) / pi;
+}
+
+
+float power_heuristic(float pdf_a, float pdf_b) {
+        float a2 = pdf_a * pdf_a;
+        float b2 = pdf_b * pdf_b;
+        return a2 + b2 > 0.0f ? a2 / (a2 + b2) : 0.0f;
+}
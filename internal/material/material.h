@@ -0,0 +1,118 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <variant>
+
+// Everything a BSDF needs to know about the surface point being shaded. The normal always faces the side wo is on,
+// front_face records whether that is the geometric outside of the shape(needed by refractive materials).
+struct SurfaceHit {
+        glm::vec3 wo;     // direction towards the previous path vertex
+        glm::vec3 normal;
+        glm::vec3 albedo; // shape color in [0, 1]
+        bool front_face;
+};
+
+struct BsdfSample {
+        glm::vec3 direction;
+        glm::vec3 weight; // f * cos / pdf
+        float pdf;        // solid angle pdf, 0 for delta lobes
+        bool is_specular;
+};
+
+template<typename Impl>
+struct MaterialStruct {
+        [[nodiscard]] BsdfSample sample(uint32_t &seed, const SurfaceHit &hit) const noexcept {
+                return static_cast<const Impl &>(*this).sample_impl(seed, hit);
+        }
+        [[nodiscard]] glm::vec3 evaluate(const SurfaceHit &hit, glm::vec3 wi) const noexcept {
+                return static_cast<const Impl &>(*this).evaluate_impl(hit, wi);
+        }
+        [[nodiscard]] float pdf(const SurfaceHit &hit, glm::vec3 wi) const noexcept {
+                return static_cast<const Impl &>(*this).pdf_impl(hit, wi);
+        }
+        [[nodiscard]] bool is_specular() const noexcept {
+                return static_cast<const Impl &>(*this).is_specular_impl();
+        }
+};
+
+
+class Lambertian : public MaterialStruct<Lambertian> {
+public:  // Public Constructors/Destructors/Overloads
+        Lambertian() = default;
+public:  // Public Member Functions
+        [[nodiscard]] BsdfSample sample_impl(uint32_t &seed, const SurfaceHit &hit) const noexcept;
+        [[nodiscard]] glm::vec3 evaluate_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept;
+        [[nodiscard]] float pdf_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept;
+        [[nodiscard]] bool is_specular_impl() const noexcept { return false; }
+public:  // Public Member Variables
+private: // Private Member Functions
+private: // Private Member Variables
+};
+
+class Metal : public MaterialStruct<Metal> {
+public:  // Public Constructors/Destructors/Overloads
+        explicit Metal(float roughness);
+public:  // Public Member Functions
+        [[nodiscard]] BsdfSample sample_impl(uint32_t &seed, const SurfaceHit &hit) const noexcept;
+        [[nodiscard]] glm::vec3 evaluate_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept;
+        [[nodiscard]] float pdf_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept;
+        [[nodiscard]] bool is_specular_impl() const noexcept;
+public:  // Public Member Variables
+private: // Private Member Functions
+private: // Private Member Variables
+        float m_alpha{}; // GGX alpha, roughness squared
+};
+
+class Dielectric : public MaterialStruct<Dielectric> {
+public:  // Public Constructors/Destructors/Overloads
+        explicit Dielectric(float ior);
+public:  // Public Member Functions
+        [[nodiscard]] BsdfSample sample_impl(uint32_t &seed, const SurfaceHit &hit) const noexcept;
+        [[nodiscard]] glm::vec3 evaluate_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept;
+        [[nodiscard]] float pdf_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept;
+        [[nodiscard]] bool is_specular_impl() const noexcept { return true; }
+public:  // Public Member Variables
+private: // Private Member Functions
+private: // Private Member Variables
+        float m_ior{};
+};
+
+// Diffuse base under a dielectric GGX coat, e.g. plastic or varnished wood
+class Glossy : public MaterialStruct<Glossy> {
+public:  // Public Constructors/Destructors/Overloads
+        explicit Glossy(float roughness, float ior = 1.5f);
+public:  // Public Member Functions
+        [[nodiscard]] BsdfSample sample_impl(uint32_t &seed, const SurfaceHit &hit) const noexcept;
+        [[nodiscard]] glm::vec3 evaluate_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept;
+        [[nodiscard]] float pdf_impl(const SurfaceHit &hit, glm::vec3 wi) const noexcept;
+        [[nodiscard]] bool is_specular_impl() const noexcept { return false; }
+public:  // Public Member Variables
+private: // Private Member Functions
+        [[nodiscard]] float specular_probability(const SurfaceHit &hit) const noexcept;
+private: // Private Member Variables
+        float m_alpha{};
+        float m_f0{}; // normal incidence reflectance of the coat
+};
+
+class Material : public std::variant<Lambertian, Metal, Dielectric, Glossy> {
+public:  // Public Constructors/Destructors/Overloads
+        using variant<Lambertian, Metal, Dielectric, Glossy>::variant;
+public:  // Public Member Functions
+        [[nodiscard]] BsdfSample sample(uint32_t &seed, const SurfaceHit &hit) const noexcept {
+                return std::visit([&seed, &hit](auto &&material) { return material.sample(seed, hit); }, *this);
+        }
+        
+        [[nodiscard]] glm::vec3 evaluate(const SurfaceHit &hit, glm::vec3 wi) const noexcept {
+                return std::visit([&hit, wi](auto &&material) { return material.evaluate(hit, wi); }, *this);
+        }
+        
+        [[nodiscard]] float pdf(const SurfaceHit &hit, glm::vec3 wi) const noexcept {
+                return std::visit([&hit, wi](auto &&material) { return material.pdf(hit, wi); }, *this);
+        }
+        
+        [[nodiscard]] bool is_specular() const noexcept {
+                return std::visit([](auto &&material) { return material.is_specular(); }, *this);
+        }
+};
+
+// MIS weight for a sample drawn from the strategy with pdf_a, when pdf_b could also have produced it
+[[nodiscard]] float power_heuristic(float pdf_a, float pdf_b);
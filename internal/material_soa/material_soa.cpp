@@ -0,0 +1 @@
+#include "material_soa.h"
@@ -0,0 +1,98 @@
+#pragma once
+#include <vector>
+#include "material.h"
+
+
+#ifdef SOA
+
+enum class MaterialType {
+        Lambertian, Metal, Dielectric, Glossy
+};
+
+struct MaterialHandle {
+        MaterialType type = MaterialType::Lambertian;
+        uint32_t index = 0; // index 0 of every table is its default material
+};
+
+// Materials only describe the BSDF, the albedo/emission still come from the color and intensity stored next to each shape.
+class MaterialSoA {
+public:
+        std::vector<Lambertian> lambertians{Lambertian()};
+        std::vector<Metal> metals{Metal(0.0f)};
+        std::vector<Dielectric> dielectrics{Dielectric(1.5f)};
+        std::vector<Glossy> glossies{Glossy(0.3f)};
+        
+        MaterialHandle insert(const Lambertian &lambertian) {
+                lambertians.push_back(lambertian);
+                return {.type = MaterialType::Lambertian, .index = uint32_t(lambertians.size() - 1)};
+        }
+        MaterialHandle insert(const Metal &metal) {
+                metals.push_back(metal);
+                return {.type = MaterialType::Metal, .index = uint32_t(metals.size() - 1)};
+        }
+        MaterialHandle insert(const Dielectric &dielectric) {
+                dielectrics.push_back(dielectric);
+                return {.type = MaterialType::Dielectric, .index = uint32_t(dielectrics.size() - 1)};
+        }
+        MaterialHandle insert(const Glossy &glossy) {
+                glossies.push_back(glossy);
+                return {.type = MaterialType::Glossy, .index = uint32_t(glossies.size() - 1)};
+        }
+        
+        BsdfSample sample(MaterialHandle material, uint32_t &seed, const SurfaceHit &hit) const {
+                switch (material.type) {
+                        case MaterialType::Lambertian:
+                                return lambertians[material.index].sample(seed, hit);
+                        case MaterialType::Metal:
+                                return metals[material.index].sample(seed, hit);
+                        case MaterialType::Dielectric:
+                                return dielectrics[material.index].sample(seed, hit);
+                        case MaterialType::Glossy:
+                                return glossies[material.index].sample(seed, hit);
+                }
+                return lambertians[0].sample(seed, hit);
+        }
+        
+        glm::vec3 evaluate(MaterialHandle material, const SurfaceHit &hit, glm::vec3 wi) const {
+                switch (material.type) {
+                        case MaterialType::Lambertian:
+                                return lambertians[material.index].evaluate(hit, wi);
+                        case MaterialType::Metal:
+                                return metals[material.index].evaluate(hit, wi);
+                        case MaterialType::Dielectric:
+                                return dielectrics[material.index].evaluate(hit, wi);
+                        case MaterialType::Glossy:
+                                return glossies[material.index].evaluate(hit, wi);
+                }
+                return glm::vec3{0};
+        }
+        
+        float pdf(MaterialHandle material, const SurfaceHit &hit, glm::vec3 wi) const {
+                switch (material.type) {
+                        case MaterialType::Lambertian:
+                                return lambertians[material.index].pdf(hit, wi);
+                        case MaterialType::Metal:
+                                return metals[material.index].pdf(hit, wi);
+                        case MaterialType::Dielectric:
+                                return dielectrics[material.index].pdf(hit, wi);
+                        case MaterialType::Glossy:
+                                return glossies[material.index].pdf(hit, wi);
+                }
+                return 0.0f;
+        }
+        
+        bool is_specular(MaterialHandle material) const {
+                switch (material.type) {
+                        case MaterialType::Lambertian:
+                                return lambertians[material.index].is_specular();
+                        case MaterialType::Metal:
+                                return metals[material.index].is_specular();
+                        case MaterialType::Dielectric:
+                                return dielectrics[material.index].is_specular();
+                        case MaterialType::Glossy:
+                                return glossies[material.index].is_specular();
+                }
+                return false;
+        }
+};
+#endif
@@ -0,0 +1,109 @@
+#include "mesh.h"
+#include <algorithm>
+#include <limits>
+
+static constexpr float miss_value = std::numeric_limits<float>::max();
+static constexpr float quantization_levels = 65535.0f;
+
+TriangleMesh::TriangleMesh(std::span<const glm::vec3> positions, std::span<const glm::uvec3> indices, std::span<const glm::vec2> uvs, bool quantize, const allocator_type &allocator)
+        : m_positions(allocator), m_quantized_positions(allocator), m_indices(indices.begin(), indices.end(), allocator), m_uvs(uvs.begin(), uvs.end(), allocator) {
+        m_bounds_min = glm::vec3{std::numeric_limits<float>::max()};
+        m_bounds_max = glm::vec3{std::numeric_limits<float>::lowest()};
+        for (glm::vec3 position: positions) {
+                m_bounds_min = glm::min(m_bounds_min, position);
+                m_bounds_max = glm::max(m_bounds_max, position);
+        }
+        
+        if (!quantize) {
+                m_positions.assign(positions.begin(), positions.end());
+                return;
+        }
+        // The largest code decodes exactly to the maximum bound, so the bounds still enclose every decoded vertex.
+        // Flat axes only ever hold code 0, any non zero step keeps the mapping into quantized space invertible.
+        m_quantization_step = (m_bounds_max - m_bounds_min) / quantization_levels;
+        for (int axis = 0; axis < 3; axis++)
+                if (m_quantization_step[axis] <= 0.0f)
+                        m_quantization_step[axis] = 1.0f;
+        m_quantized_positions.reserve(positions.size());
+        for (glm::vec3 position: positions) {
+                glm::vec3 code = (position - m_bounds_min) / m_quantization_step;
+                m_quantized_positions.emplace_back(glm::clamp(glm::vec3{roundf(code.x), roundf(code.y), roundf(code.z)}, 0.0f, quantization_levels));
+        }
+}
+
+TriangleMesh::TriangleMesh(const TriangleMesh &other, const allocator_type &allocator)
+        : m_positions(other.m_positions, allocator), m_quantized_positions(other.m_quantized_positions, allocator), m_indices(other.m_indices, allocator), m_uvs(other.m_uvs, allocator),
+          m_bounds_min(other.m_bounds_min), m_bounds_max(other.m_bounds_max), m_quantization_step(other.m_quantization_step) {}
+
+// Moves the buffers when other allocates from the same resource and copies them into allocator's resource otherwise
+TriangleMesh::TriangleMesh(TriangleMesh &&other, const allocator_type &allocator)
+        : m_positions(std::move(other.m_positions), allocator), m_quantized_positions(std::move(other.m_quantized_positions), allocator), m_indices(std::move(other.m_indices), allocator), m_uvs(std::move(other.m_uvs), allocator),
+          m_bounds_min(other.m_bounds_min), m_bounds_max(other.m_bounds_max), m_quantization_step(other.m_quantization_step) {}
+
+// Slab test against the mesh bounds, rejects the whole mesh when it is missed or lies behind a closer hit
+bool MeshView::intersect_bounds(const Ray &ray, float max_distance) const noexcept {
+        glm::vec3 inverse_direction = 1.0f / ray.direction;
+        glm::vec3 t0 = (bounds_min - ray.origin) * inverse_direction;
+        glm::vec3 t1 = (bounds_max - ray.origin) * inverse_direction;
+        glm::vec3 t_near = glm::min(t0, t1);
+        glm::vec3 t_far = glm::max(t0, t1);
+        float entry = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+        float exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, max_distance));
+        return entry <= exit;
+}
+
+float MeshView::intersect(const Ray &ray, float max_distance, uint32_t &triangle_index, glm::vec2 &barycentrics) const noexcept {
+        if (!intersect_bounds(ray, max_distance))
+                return miss_value;
+        
+        float closest = max_distance;
+        bool hit = false;
+        auto closest_hit = [&](const Ray &local_ray, auto &&decode) {
+                for (uint32_t i = 0; i < indices.size(); i++) {
+                        glm::uvec3 corners = indices[i];
+                        glm::vec2 triangle_barycentrics;
+                        float intersection_dist = Triangle(decode(corners.x), decode(corners.y), decode(corners.z)).intersect(local_ray, triangle_barycentrics);
+                        if (intersection_dist > 0.001 && intersection_dist < closest) {
+                                closest = intersection_dist;
+                                triangle_index = i;
+                                barycentrics = triangle_barycentrics;
+                                hit = true;
+                        }
+                }
+        };
+        // Quantized meshes are intersected in quantized space, the ray is mapped there once instead of decoding every
+        // vertex. Distances and barycentrics are unchanged by the affine map.
+        if (quantized())
+                closest_hit(Ray{(ray.origin - bounds_min) / quantization_step, ray.direction / quantization_step}, [this](uint32_t index) { return glm::vec3(quantized_positions[index]); });
+        else
+                closest_hit(ray, [this](uint32_t index) { return positions[index]; });
+        return hit ? closest : miss_value;
+}
+
+glm::vec3 MeshView::normal(uint32_t triangle_index, const Ray &ray) const noexcept {
+        glm::vec3 normal = triangle(triangle_index).calculate_normal();
+        return glm::dot(ray.direction, normal) > std::numeric_limits<float>::epsilon() ? -normal : normal;
+}
+
+bool MeshView::front_face(uint32_t triangle_index, const Ray &ray) const noexcept {
+        return glm::dot(ray.direction, triangle(triangle_index).calculate_normal()) < 0.0f;
+}
+
+TriangleUVs MeshView::triangle_uvs(uint32_t triangle_index) const noexcept {
+        if (uvs.empty())
+                return default_triangle_uvs;
+        glm::uvec3 corners = indices[triangle_index];
+        return {uvs[corners.x], uvs[corners.y], uvs[corners.z]};
+}
+
+glm::vec2 MeshView::uv(uint32_t triangle_index, glm::vec2 barycentrics) const noexcept {
+        return triangle_uv(triangle_uvs(triangle_index), barycentrics);
+}
+
+float MeshView::uv_density(uint32_t triangle_index) const noexcept {
+        return triangle_uv_density(triangle(triangle_index), triangle_uvs(triangle_index));
+}
+
+size_t MeshView::geometry_bytes() const noexcept {
+        return positions.size() * sizeof(glm::vec3) + quantized_positions.size() * sizeof(glm::u16vec3) + indices.size() * sizeof(glm::uvec3) + uvs.size() * sizeof(glm::vec2);
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <array>
+#include <memory_resource>
+#include <span>
+#include <vector>
+#include "shape.h"
+
+// Read only geometry of an indexed triangle mesh and all of its intersection and shading code. The buffers are owned
+// elsewhere, by a TriangleMesh or by the block of a FrozenShapeSoA, so a view is trivially copyable.
+class MeshView {
+public:  // Public Member Functions
+        // Closest hit nearer than max_distance, triangle and barycentrics are only written on a hit
+        [[nodiscard]] float intersect(const Ray &ray, float max_distance, uint32_t &triangle, glm::vec2 &barycentrics) const noexcept;
+        [[nodiscard]] glm::vec3 normal(uint32_t triangle, const Ray &ray) const noexcept;
+        [[nodiscard]] bool front_face(uint32_t triangle, const Ray &ray) const noexcept;
+        [[nodiscard]] glm::vec2 uv(uint32_t triangle, glm::vec2 barycentrics) const noexcept;
+        [[nodiscard]] float uv_density(uint32_t triangle) const noexcept;
+        
+        [[nodiscard]] size_t triangle_count() const noexcept { return indices.size(); }
+        [[nodiscard]] size_t vertex_count() const noexcept { return positions.size() + quantized_positions.size(); }
+        [[nodiscard]] bool quantized() const noexcept { return !quantized_positions.empty(); }
+        [[nodiscard]] size_t geometry_bytes() const noexcept;
+public:  // Public Member Variables
+        std::span<const glm::vec3> positions;              // empty when quantized
+        std::span<const glm::u16vec3> quantized_positions; // empty unless quantized
+        std::span<const glm::uvec3> indices;
+        std::span<const glm::vec2> uvs;
+        
+        glm::vec3 bounds_min{};
+        glm::vec3 bounds_max{};
+        glm::vec3 quantization_step{}; // bounds extent / 65535
+private: // Private Member Functions
+        [[nodiscard]] glm::vec3 vertex(uint32_t index) const noexcept {
+                if (quantized_positions.empty())
+                        return positions[index];
+                return bounds_min + glm::vec3(quantized_positions[index]) * quantization_step;
+        }
+        [[nodiscard]] Triangle triangle(uint32_t index) const noexcept {
+                glm::uvec3 corners = indices[index];
+                return {vertex(corners.x), vertex(corners.y), vertex(corners.z)};
+        }
+        [[nodiscard]] TriangleUVs triangle_uvs(uint32_t index) const noexcept;
+        [[nodiscard]] bool intersect_bounds(const Ray &ray, float max_distance) const noexcept;
+};
+
+// Indexed triangle mesh with one shared vertex buffer. Shading data (color, material, texture) is stored once per mesh by
+// ShapeSoA and normals are recomputed from the decoded vertices, so a closed mesh costs 12 bytes of indices plus roughly
+// half a vertex per triangle instead of a full Triangle, normal, color and intensity each.
+// With quantize set, positions are stored as 16 bit fractions of the mesh bounds (6 bytes instead of 12). The intersection
+// loop only widens them to float and tests against the ray mapped into the same space, shading decodes to world space.
+// Shared vertices decode to the same point so the mesh stays watertight.
+// The buffers allocate from a std::pmr memory resource, and a mesh inserted into a ShapeSoA is moved into the
+// ShapeSoA's resource like any other allocator aware element.
+class TriangleMesh {
+public:  // Public Constructors/Destructors/Overloads
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+        
+        // uvs are per vertex and optional, triangles without them get the same default uvs as a Triangle
+        TriangleMesh(std::span<const glm::vec3> positions, std::span<const glm::uvec3> indices, std::span<const glm::vec2> uvs = {}, bool quantize = false, const allocator_type &allocator = {});
+        TriangleMesh(const TriangleMesh &other, const allocator_type &allocator = {});
+        TriangleMesh(TriangleMesh &&other) noexcept = default;
+        TriangleMesh(TriangleMesh &&other, const allocator_type &allocator);
+        TriangleMesh &operator=(const TriangleMesh &other) = default;
+        TriangleMesh &operator=(TriangleMesh &&other) = default;
+public:  // Public Member Functions
+        [[nodiscard]] MeshView view() const noexcept {
+                return {.positions = m_positions, .quantized_positions = m_quantized_positions, .indices = m_indices, .uvs = m_uvs, .bounds_min = m_bounds_min, .bounds_max = m_bounds_max, .quantization_step = m_quantization_step};
+        }
+        [[nodiscard]] allocator_type get_allocator() const noexcept { return m_indices.get_allocator(); }
+        
+        [[nodiscard]] float intersect(const Ray &ray, float max_distance, uint32_t &triangle, glm::vec2 &barycentrics) const noexcept {
+                return view().intersect(ray, max_distance, triangle, barycentrics);
+        }
+        [[nodiscard]] glm::vec3 normal(uint32_t triangle, const Ray &ray) const noexcept { return view().normal(triangle, ray); }
+        [[nodiscard]] bool front_face(uint32_t triangle, const Ray &ray) const noexcept { return view().front_face(triangle, ray); }
+        [[nodiscard]] glm::vec2 uv(uint32_t triangle, glm::vec2 barycentrics) const noexcept { return view().uv(triangle, barycentrics); }
+        [[nodiscard]] float uv_density(uint32_t triangle) const noexcept { return view().uv_density(triangle); }
+        
+        [[nodiscard]] size_t triangle_count() const noexcept { return m_indices.size(); }
+        [[nodiscard]] size_t vertex_count() const noexcept { return m_positions.size() + m_quantized_positions.size(); }
+        [[nodiscard]] bool quantized() const noexcept { return !m_quantized_positions.empty(); }
+        [[nodiscard]] size_t geometry_bytes() const noexcept { return view().geometry_bytes(); }
+public:  // Public Member Variables
+private: // Private Member Functions
+private: // Private Member Variables
+        std::pmr::vector<glm::vec3> m_positions;              // empty when quantized
+        std::pmr::vector<glm::u16vec3> m_quantized_positions; // empty unless quantized
+        std::pmr::vector<glm::uvec3> m_indices;
+        std::pmr::vector<glm::vec2> m_uvs;
+        
+        glm::vec3 m_bounds_min{};
+        glm::vec3 m_bounds_max{};
+        glm::vec3 m_quantization_step{}; // bounds extent / 65535
+};
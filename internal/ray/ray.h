@@ -11,4 +11,10 @@ public:  // Public Member Variables
         glm::vec3 direction;
 private: // Private Member Functions
 private: // Private Member Variables
+};
+
+// Width of a ray's footprint, growing linearly with distance. Used to pick texture mip levels.
+struct RayCone {
+        float width;
+        float spread; // radians
 };
\ No newline at end of file
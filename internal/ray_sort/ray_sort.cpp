@@ -0,0 +1,18 @@
+#include "ray_sort.h"
+
+// Spreads the low 10 bits of value so two zero bits follow each one
+static uint32_t expand_bits(uint32_t value) {
+        value &= 0x3ffu;
+        value = (value | (value << 16)) & 0x030000ffu;
+        value = (value | (value << 8)) & 0x0300f00fu;
+        value = (value | (value << 4)) & 0x030c30c3u;
+        value = (value | (value << 2)) & 0x09249249u;
+        return value;
+}
+
+uint64_t ray_sort_key(const Ray &ray, glm::vec3 bounds_min, glm::vec3 inverse_extent) noexcept {
+        uint64_t octant = (ray.direction.x < 0.0f ? 1u : 0u) | (ray.direction.y < 0.0f ? 2u : 0u) | (ray.direction.z < 0.0f ? 4u : 0u);
+        glm::vec3 cell = glm::clamp((ray.origin - bounds_min) * inverse_extent, 0.0f, 1.0f) * 1023.0f;
+        uint32_t morton = expand_bits(uint32_t(cell.x)) | (expand_bits(uint32_t(cell.y)) << 1) | (expand_bits(uint32_t(cell.z)) << 2);
+        return (octant << 30) | morton;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "ray.h"
+
+// Sort key of a ray, the direction octant in the top 3 bits and below it the Morton code of the origin quantized to
+// 10 bits per axis inside the box starting at bounds_min with extent 1 / inverse_extent. Rays with close keys leave
+// nearby points in similar directions, so tracing them in key order keeps the same geometry and texture tiles in cache.
+[[nodiscard]] uint64_t ray_sort_key(const Ray &ray, glm::vec3 bounds_min, glm::vec3 inverse_extent) noexcept;
+
+// Scratch buffers of sort_by_ray, kept by the caller so batches stop allocating once they have grown
+template<typename T>
+struct RaySortBuffers {
+        std::vector<std::pair<uint64_t, uint32_t>> keys;
+        std::vector<T> sorted;
+};
+
+// Reorders items into ascending ray_sort_key order, ray_of(item) returns the ray of an item. The origins are quantized
+// relative to the bounds of the batch itself.
+template<typename T, typename F>
+void sort_by_ray(std::vector<T> &items, F &&ray_of, RaySortBuffers<T> &buffers) {
+        if (items.size() < 2)
+                return;
+
+        glm::vec3 bounds_min{std::numeric_limits<float>::max()};
+        glm::vec3 bounds_max{std::numeric_limits<float>::lowest()};
+        for (const T &item: items) {
+                bounds_min = glm::min(bounds_min, ray_of(item).origin);
+                bounds_max = glm::max(bounds_max, ray_of(item).origin);
+        }
+        glm::vec3 inverse_extent = 1.0f / glm::max(bounds_max - bounds_min, glm::vec3{1e-6f});
+
+        buffers.keys.resize(items.size());
+        for (uint32_t i = 0; i < items.size(); i++)
+                buffers.keys[i] = {ray_sort_key(ray_of(items[i]), bounds_min, inverse_extent), i};
+        std::sort(buffers.keys.begin(), buffers.keys.end());
+
+        buffers.sorted.clear();
+        for (const auto &[key, index]: buffers.keys)
+                buffers.sorted.push_back(std::move(items[index]));
+        std::swap(items, buffers.sorted);
+}
+
+// Counters of the sorted ray stage, added to once per batch
+struct RayStatistics {
+        std::atomic<uint64_t> rays{0};
+        std::atomic<uint64_t> ray_hits{0};
+        std::atomic<uint64_t> shadow_rays{0};
+        std::atomic<uint64_t> shadow_rays_unoccluded{0};
+        std::atomic<uint64_t> batches{0};
+
+        [[nodiscard]] double hit_rate() const noexcept { return double(ray_hits) / double(std::max<uint64_t>(rays, 1)); }
+        [[nodiscard]] double unoccluded_rate() const noexcept { return double(shadow_rays_unoccluded) / double(std::max<uint64_t>(shadow_rays, 1)); }
+};
@@ -52,4 +52,19 @@ glm::vec3 random_vector_in_cone(uint32_t &seed, glm::vec3 N, float angle) {
         
         glm::vec3 sampleVec = tbn * H;
         return normalize(sampleVec);
+}
+
+glm::vec3 random_vector_in_solid_cone(uint32_t &seed, glm::vec3 N, float cos_theta_max) { // Uniform over the solid angle of the cone
+        float phi = 2.0f * std::numbers::pi_v<float> * random_pcg(seed);
+        float cosTheta = 1.0f - random_pcg(seed) * (1.0f - cos_theta_max);
+        float sinTheta = sqrtf(glm::max(0.0f, 1.0f - cosTheta * cosTheta));
+        
+        return normalize(tangent_to_world({cosf(phi) * sinTheta, sinf(phi) * sinTheta, cosTheta}, N));
+}
+
+glm::vec3 tangent_to_world(glm::vec3 local, glm::vec3 N) {
+        glm::vec3 up = abs(N.z) < 0.999 ? glm::vec3(0.0, 0.0, 1.0) : glm::vec3(1.0, 0.0, 0.0);
+        glm::vec3 tangent = normalize(cross(up, N));
+        glm::vec3 bitangent = cross(N, tangent);
+        return glm::mat3(tangent, bitangent, N) * local;
 }
\ No newline at end of file
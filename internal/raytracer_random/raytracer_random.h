@@ -15,4 +15,8 @@
 
 [[nodiscard]] glm::vec3 random_unit_vector_pcg(uint32_t &seed);
 
-[[nodiscard]] glm::vec3 random_vector_in_cone(uint32_t &seed, glm::vec3 N, float angle);
\ No newline at end of file
+[[nodiscard]] glm::vec3 random_vector_in_cone(uint32_t &seed, glm::vec3 N, float angle);
+
+[[nodiscard]] glm::vec3 random_vector_in_solid_cone(uint32_t &seed, glm::vec3 N, float cos_theta_max);
+
+[[nodiscard]] glm::vec3 tangent_to_world(glm::vec3 local, glm::vec3 N);
\ No newline at end of file
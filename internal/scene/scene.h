@@ -4,12 +4,70 @@
 #include "ray.h"
 #include "camera.h"
 #include "shape_soa.h"
+#include "baked_shape_soa.h"
+#include "frozen_shape_soa.h"
+#include "material.h"
+#include "material_soa.h"
+#include "texture.h"
+#include "environment.h"
+#include "ray_sort.h"
+#include "splat_framebuffer.h"
 #include "raytracer_random.h"
 
 static constexpr int sample_count = 20000;
 static constexpr int recurse_depth = 2000;
+static constexpr uint32_t sorted_batch_pixels = 1 << 16; // pixels per traceRowsSorted call, smaller batches sort into little coherence
 
-template<uint32_t WIDTH, uint32_t HEIGHT>
+// Surface state at a path vertex, everything needed to estimate direct light and pick the next bounce
+struct ShadingPoint {
+        glm::vec3 position;
+        glm::vec3 normal;
+        SurfaceHit surface;
+#ifdef SOA
+        MaterialHandle material;
+#else
+        const Material *material;
+#endif
+        bool is_specular;
+        float cone_width;
+};
+
+// Next event estimation sample, contribution is added if the ray reaches its light unoccluded
+struct ShadowRay {
+        static constexpr uint32_t environment_light = std::numeric_limits<uint32_t>::max();
+        
+        Ray ray;
+        glm::vec3 contribution;
+        uint32_t light_index; // circle light, or environment_light when the ray has to escape the scene
+};
+
+// Continuation of a path, a zero weight means the path was absorbed
+struct Bounce {
+        Ray ray;
+        RayCone cone;
+        glm::vec3 weight;
+        float bsdf_pdf; // 0 for specular bounces
+};
+
+// Which pass counts the circle lights a camera path reaches. Light paths take over the caustics, camera paths whose
+// first vertex is non specular and which reach the light through a chain of specular bounces, as they splat those
+// directly while the camera only finds them by chance.
+enum class CausticState : uint8_t {
+        Gathered,  // every emitter hit counts, light paths are off or the path's first vertex was specular
+        CameraRay, // camera ray of a render that also traces light paths
+        Diffuse,   // the last bounce was non specular
+        Specular,  // the last bounce was specular and followed a non specular vertex, circle lights hit now are splatted
+};
+
+[[nodiscard]] constexpr CausticState next_caustic_state(CausticState state, bool is_specular) noexcept {
+        if (state == CausticState::Gathered || (state == CausticState::CameraRay && is_specular))
+                return CausticState::Gathered;
+        return is_specular ? CausticState::Specular : CausticState::Diffuse;
+}
+
+// SHAPES is the shape storage of SOA builds, ShapeSoA for scenes built at runtime, FrozenShapeSoA for scenes built at
+// runtime and then frozen, or BakedShapeSoA for constexpr scenes
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES = ShapeSoA>
 class Scene {
 public:  // Public Constructors/Destructors/Overloads
         Scene() = default;
@@ -17,14 +75,19 @@ public:  // Public Constructors/Destructors/Overloads
                 : m_camera(camera_origin, camera_look_direction, camera_up_direction, camera_fov, float(WIDTH) / float(HEIGHT)) {};
 public:  // Public Member Functions
 #ifndef SOA
-        void addShape(const Shape &shape, glm::vec3 color, float intensity) noexcept;
-        void addShape(Shape &&shape, glm::vec3 color, float intensity) noexcept;
+        void addShape(const Shape &shape, glm::vec3 color, float intensity, const Material &material = Lambertian(), TextureHandle texture = {}) noexcept;
+        void addShape(Shape &&shape, glm::vec3 color, float intensity, const Material &material = Lambertian(), TextureHandle texture = {}) noexcept;
 #endif
 
-        void render();
-        void traceScanline(uint32_t v, int recursion_depth);
+        void render(int samples = sample_count);
+        void traceScanline(uint32_t v, int recursion_depth, int samples = sample_count);
+#ifdef SOA
+        void traceRowsSorted(uint32_t first_row, uint32_t rows, int recursion_depth, int samples = sample_count);
+        [[nodiscard]] static constexpr uint32_t sorted_batch_rows() noexcept { return std::clamp(sorted_batch_pixels / WIDTH, 1u, HEIGHT); }
+        void traceLightPaths(uint32_t &seed, uint32_t count, int recursion_depth);
+#endif
         
-        glm::vec3 sample(uint32_t &seed, Ray &&ray, int recursion_depth, uint32_t &samples_obtained);
+        glm::vec3 sample(uint32_t &seed, Ray &&ray, int recursion_depth, float bsdf_pdf = 0.0f, RayCone cone = {}, CausticState caustic = CausticState::Gathered);
 #ifndef SOA
         HitBuffer intersectWorld(const Ray &ray);
 #endif
@@ -32,7 +95,26 @@ public:  // Public Member Functions
         HitBuffer intersectSoA(const Ray &ray);
 #endif
 public:  // Public Member Variables
+        uint32_t m_seed_offset = 0; // added to every path's seed, renders offset by more than WIDTH * HEIGHT are independent
+        float m_max_sample_luminance = 0.0f; // above 0, brighter camera samples and light path splats are scaled down to it
+#ifdef SOA
+        bool m_sort_secondary_rays = false; // render() traces batches of sorted_batch_rows() rows through traceRowsSorted
+        RayStatistics m_ray_statistics;     // only counted by traceRowsSorted
+        bool m_trace_light_paths = false;   // render() adds one light path per camera sample, splatted into m_splat_image
+#endif
 private: // Private Member Functions
+        void store(uint32_t x, uint32_t y, glm::vec3 pixel_color);
+        glm::vec3 clamped(glm::vec3 radiance);
+        CausticState camera_caustic_state();
+        bool splatted(const HitBuffer &hit, CausticState caustic);
+        glm::vec3 escaped(const Ray &ray, float bsdf_pdf);
+        bool is_emitter(const HitBuffer &hit);
+        glm::vec3 emitted(const Ray &ray, const HitBuffer &hit, float bsdf_pdf);
+        ShadingPoint shade(const Ray &ray, const HitBuffer &hit, RayCone cone);
+        template<typename F>
+        void next_event_estimate(uint32_t &seed, const ShadingPoint &point, F &&emit);
+        bool unoccluded(const ShadowRay &shadow);
+        Bounce bounce(uint32_t &seed, const Ray &ray, const ShadingPoint &point, RayCone cone);
 public: // Private Member Variables
 #ifndef SOA
         std::vector<Shape> m_shapes{};
@@ -41,57 +123,111 @@ public: // Private Member Variables
         // Material info
         std::vector<glm::vec3> m_colors{};
         std::vector<float> m_intensities{};
+        std::vector<Material> m_materials{};
+        std::vector<TextureHandle> m_textures{};
 #endif
         Image<WIDTH, HEIGHT> m_image{};
         Image<WIDTH, HEIGHT> m_bloom_image{};
         Camera m_camera;
+        TextureCache m_texture_cache;
+        Environment m_environment; // black unless a map is loaded
 #ifdef SOA
-        ShapeSoA m_shape_soa;
+        SHAPES m_shape_soa;
+        MaterialSoA m_material_soa;
+        SplatFramebuffer<WIDTH, HEIGHT> m_splat_image; // light path contributions, summed over every light path traced
 #endif
 };
 
 
 
 #ifndef SOA
-template<uint32_t WIDTH, uint32_t HEIGHT>
-HitBuffer Scene<WIDTH, HEIGHT>::intersectWorld(const Ray &ray) {
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+HitBuffer Scene<WIDTH, HEIGHT, SHAPES>::intersectWorld(const Ray &ray) {
         float closest_intersection_distance = std::numeric_limits<float>::max();
         size_t closest_shape_index = 0;
+        glm::vec2 closest_barycentrics{};
         for (int i = 0; auto &shape: m_shapes) {
-                float intersection_dist = shape.intersect(ray);
+                glm::vec2 barycentrics{};
+                float intersection_dist = shape.intersect(ray, barycentrics);
                 if (intersection_dist > 0.001 && intersection_dist < closest_intersection_distance) {
                         closest_intersection_distance = intersection_dist;
                         closest_shape_index = i;
+                        closest_barycentrics = barycentrics;
                 }
                 i++;
         }
-        return HitBuffer{.index = closest_shape_index, .distance = closest_intersection_distance};
+        return HitBuffer{.index = closest_shape_index, .distance = closest_intersection_distance, .barycentrics = closest_barycentrics};
 }
 #endif
 #ifdef SOA
-template<uint32_t WIDTH, uint32_t HEIGHT>
-HitBuffer Scene<WIDTH, HEIGHT>::intersectSoA(const Ray &ray) {
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+HitBuffer Scene<WIDTH, HEIGHT, SHAPES>::intersectSoA(const Ray &ray) {
         return m_shape_soa.intersect_all(ray);
 }
 #endif
 
-template<uint32_t WIDTH, uint32_t HEIGHT>
-glm::vec3 Scene<WIDTH, HEIGHT>::sample(uint32_t &seed, Ray &&ray, int recursion_depth, uint32_t &samples_obtained) {
-        if (recursion_depth <= 0) { // Return miss color when recursion depth is exceeded
-                samples_obtained++;
-                return glm::vec3{0};
-        }
+// Writes a finished pixel, bright pixels also go to the bloom buffer
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+void Scene<WIDTH, HEIGHT, SHAPES>::store(uint32_t x, uint32_t y, glm::vec3 pixel_color) {
+        if (glm::length(pixel_color) > 5.0f) // Write bright pixels to the bloom buffer
+                m_bloom_image.set(x, y, pixel_color);
+        else
+                m_bloom_image.set(x, y, {0, 0, 0});
+        m_image.set(x, y, pixel_color);
+}
+
+// Bounds what one path adds to a pixel. Rare paths that find a small light through specular bounces, which light paths
+// cannot splat either when the camera sees them through glass, otherwise leave fireflies that take thousands of samples
+// to average out. The image gets darker where they land, in exchange for variance that falls with every sample.
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+glm::vec3 Scene<WIDTH, HEIGHT, SHAPES>::clamped(glm::vec3 radiance) {
+        float luminance = glm::dot(radiance, glm::vec3{0.2126f, 0.7152f, 0.0722f});
+        if (m_max_sample_luminance <= 0.0f || luminance <= m_max_sample_luminance)
+                return radiance;
+        return radiance * (m_max_sample_luminance / luminance);
+}
 
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+CausticState Scene<WIDTH, HEIGHT, SHAPES>::camera_caustic_state() {
 #ifdef SOA
-        HitBuffer hit = intersectSoA(ray);
+        return m_trace_light_paths ? CausticState::CameraRay : CausticState::Gathered;
 #else
-        HitBuffer hit = intersectWorld(ray);
+        return CausticState::Gathered;
+#endif
+}
+
+// Whether an emitter hit is left to the light paths, which start at circle lights only
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+bool Scene<WIDTH, HEIGHT, SHAPES>::splatted(const HitBuffer &hit, CausticState caustic) {
+#ifdef SOA
+        return caustic == CausticState::Specular && hit.shape_type == ShapeType::Circle;
+#else
+        return false;
 #endif
-        if (!hit.is_hit()) { // Return miss color on miss
-                samples_obtained++;
+}
+
+// Radiance carried by a ray that left the scene, MIS weighted against environment sampling after non specular bounces
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+glm::vec3 Scene<WIDTH, HEIGHT, SHAPES>::escaped(const Ray &ray, float bsdf_pdf) {
+        if (!m_environment.valid())
                 return glm::vec3{0.0, 0.0, 0.0};
-        }
+        glm::vec3 radiance = m_environment.radiance(ray.direction);
+        if (bsdf_pdf <= 0.0f)
+                return radiance;
+        return radiance * power_heuristic(bsdf_pdf, m_environment.pdf(ray.direction));
+}
 
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+bool Scene<WIDTH, HEIGHT, SHAPES>::is_emitter(const HitBuffer &hit) {
+#ifdef SOA
+        return m_shape_soa.intensity(hit.shape_type, hit.index) > 0;
+#else
+        return m_intensities[hit.index] > 0;
+#endif
+}
+
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+glm::vec3 Scene<WIDTH, HEIGHT, SHAPES>::emitted(const Ray &ray, const HitBuffer &hit, float bsdf_pdf) {
 #ifdef SOA
         auto color = m_shape_soa.color(hit.shape_type, hit.index);
         auto intensity =  m_shape_soa.intensity(hit.shape_type, hit.index);
@@ -99,116 +235,430 @@ glm::vec3 Scene<WIDTH, HEIGHT>::sample(uint32_t &seed, Ray &&ray, int recursion_
         auto color = m_colors[hit.index];
         auto intensity =  m_intensities[hit.index];
 #endif
-        if (intensity > 0) {
-                samples_obtained++;
-                if (recursion_depth == recurse_depth)
-                        return (color * intensity) / 255.0f; // Return light color on direct light intersection
-                return {0, 0, 0}; // Return miss color on indirect light intersection
-        }
-        
-        auto hit_location = ray.at(hit.distance);
+        glm::vec3 emitted = (color * intensity) / 255.0f;
+        if (bsdf_pdf <= 0.0f)
+                return emitted; // Return light color on direct light or specular intersection
 #ifdef SOA
-        auto normal = m_shape_soa.normal(hit.shape_type, hit.index, ray, hit.distance);
+        // Only circle lights are sampled by next event estimation
+        float light_pdf = hit.shape_type == ShapeType::Circle ? m_shape_soa.circles[hit.index].light_pdf(ray, hit.distance) : 0.0f;
 #else
+        float light_pdf = m_shapes[hit.index].light_pdf(ray, hit.distance);
+#endif
+        return emitted * power_heuristic(bsdf_pdf, light_pdf);
+}
+
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+ShadingPoint Scene<WIDTH, HEIGHT, SHAPES>::shade(const Ray &ray, const HitBuffer &hit, RayCone cone) {
+        float cone_width = cone.width + cone.spread * hit.distance;
+#ifdef SOA
+        auto color = m_shape_soa.color(hit.shape_type, hit.index);
+        auto normal = m_shape_soa.normal(hit.shape_type, hit.index, ray, hit.distance, hit.primitive);
+        auto material = m_shape_soa.material(hit.shape_type, hit.index);
+        bool is_specular = m_material_soa.is_specular(material);
+        bool front_face = m_shape_soa.front_face(hit.shape_type, hit.index, ray, hit.distance, hit.primitive);
+        if (TextureHandle texture = m_shape_soa.texture(hit.shape_type, hit.index); texture.valid()) {
+                glm::vec2 uv = m_shape_soa.uv(hit.shape_type, hit.index, ray, hit.distance, hit.barycentrics, hit.primitive);
+                float footprint = cone_width * m_shape_soa.uv_density(hit.shape_type, hit.index, hit.primitive) / glm::max(std::abs(glm::dot(ray.direction, normal)), 0.05f); // Stretched at grazing angles
+                color *= m_texture_cache.sample(texture, uv, footprint);
+        }
+#else
+        auto color = m_colors[hit.index];
         auto normal = m_shapes[hit.index].normal(ray, hit.distance);
+        const Material *material = &m_materials[hit.index];
+        bool is_specular = material->is_specular();
+        bool front_face = m_shapes[hit.index].front_face(ray, hit.distance);
+        if (TextureHandle texture = m_textures[hit.index]; texture.valid()) {
+                glm::vec2 uv = m_shapes[hit.index].uv(ray, hit.distance, hit.barycentrics);
+                float footprint = cone_width * m_shapes[hit.index].uv_density() / glm::max(std::abs(glm::dot(ray.direction, normal)), 0.05f); // Stretched at grazing angles
+                color *= m_texture_cache.sample(texture, uv, footprint);
+        }
 #endif
+        return ShadingPoint{
+                .position = ray.at(hit.distance),
+                .normal = normal,
+                .surface = SurfaceHit{.wo = -ray.direction, .normal = normal, .albedo = color / 255.0f, .front_face = front_face},
+                .material = material,
+                .is_specular = is_specular,
+                .cone_width = cone_width,
+        };
+}
+
+// Calls emit(ShadowRay) once per light sample, skipped for delta BSDFs as no light sample can land inside their lobe
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+template<typename F>
+void Scene<WIDTH, HEIGHT, SHAPES>::next_event_estimate(uint32_t &seed, const ShadingPoint &point, F &&emit) {
+        if (point.is_specular)
+                return;
         
-        // Next event estimation
-        glm::vec3 next_event_color{0};
+        auto sample_light = [&](auto light_index, const auto &light_source) {
+                // Sample a direction towards the light source
+                LightSample light_sample = light_source.sample_light(seed, point.position);
+                if (light_sample.pdf <= 0.0f)
+                        return;
+                
 #ifdef SOA
-        for (uint32_t light_index: m_shape_soa.m_circle_light_indices) {
-                Shape light_source = m_shape_soa.circles[light_index];
+                float light_intensity = m_shape_soa.intensity(ShapeType::Circle, light_index);
+                glm::vec3 light_color =  m_shape_soa.color(ShapeType::Circle, light_index);
+                glm::vec3 bsdf = m_material_soa.evaluate(point.material, point.surface, light_sample.direction);
+                float light_bsdf_pdf = m_material_soa.pdf(point.material, point.surface, light_sample.direction);
 #else
-        for (uint32_t light_index: m_light_indices) {
-                Shape light_source = m_shapes[light_index];
+                float light_intensity = m_intensities[light_index];
+                glm::vec3 light_color = m_colors[light_index];
+                glm::vec3 bsdf = point.material->evaluate(point.surface, light_sample.direction);
+                float light_bsdf_pdf = point.material->pdf(point.surface, light_sample.direction);
 #endif
-                // Sample a point on the light source
-                glm::vec3 light_point = light_source.random_point(seed, light_source.position() - hit_location);
-                
-                // Calculate the direction from the hit point to the light source
-                float light_distance = glm::length2(light_point - hit_location);
-                glm::vec3 light_direction = glm::normalize(light_point - hit_location);
-                
-                // Create a shadow ray to check if the hit point is occluded by other objects
-                Ray shadow_ray(hit_location + normal * 0.001f, light_direction);
+                glm::vec3 emitted = (light_color * light_intensity) / 255.0f;
+                emit(ShadowRay{.ray = Ray(point.position + point.normal * 0.001f, light_sample.direction), .contribution = bsdf * emitted * power_heuristic(light_sample.pdf, light_bsdf_pdf) / light_sample.pdf, .light_index = uint32_t(light_index)});
+        };
 #ifdef SOA
-                HitBuffer shadow_hit = intersectSoA(shadow_ray);
+        m_shape_soa.for_each_circle_light(sample_light);
 #else
-                HitBuffer shadow_hit = intersectWorld(shadow_ray);
+        for (size_t light_index: m_light_indices)
+                sample_light(light_index, m_shapes[light_index]);
 #endif
-                
-                // If the shadow ray is not occluded, calculate the light's contribution
-                if (shadow_hit.index == light_index) {
-                        // Calculate the light intensity and BRDF
+        
+        // The environment is sampled like any other light, it is visible wherever the shadow ray escapes the scene
+        if (m_environment.valid()) {
+                LightSample light_sample = m_environment.sample(seed);
+                if (light_sample.pdf <= 0.0f)
+                        return;
 #ifdef SOA
-                        float light_intensity = m_shape_soa.intensity(ShapeType::Circle, light_index);
-                        glm::vec3 light_color =  m_shape_soa.color(ShapeType::Circle, light_index);
+                glm::vec3 bsdf = m_material_soa.evaluate(point.material, point.surface, light_sample.direction);
+                float light_bsdf_pdf = m_material_soa.pdf(point.material, point.surface, light_sample.direction);
 #else
-                        float light_intensity = m_intensities[light_index];
-                        glm::vec3 light_color = m_colors[light_index];
+                glm::vec3 bsdf = point.material->evaluate(point.surface, light_sample.direction);
+                float light_bsdf_pdf = point.material->pdf(point.surface, light_sample.direction);
 #endif
-                        next_event_color += light_intensity * light_color * glm::max(glm::dot(light_direction, normal), 0.0f) / light_distance;
-                }
-                samples_obtained++;
+                glm::vec3 radiance = m_environment.radiance(light_sample.direction);
+                emit(ShadowRay{.ray = Ray(point.position + point.normal * 0.001f, light_sample.direction), .contribution = bsdf * radiance * power_heuristic(light_sample.pdf, light_bsdf_pdf) / light_sample.pdf, .light_index = ShadowRay::environment_light});
         }
+}
+
+// Checks if the shadow ray is occluded by other objects before reaching its light
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+bool Scene<WIDTH, HEIGHT, SHAPES>::unoccluded(const ShadowRay &shadow) {
+#ifdef SOA
+        HitBuffer shadow_hit = intersectSoA(shadow.ray);
+        if (shadow.light_index == ShadowRay::environment_light)
+                return !shadow_hit.is_hit();
+        return shadow_hit.shape_type == ShapeType::Circle && shadow_hit.index == shadow.light_index;
+#else
+        HitBuffer shadow_hit = intersectWorld(shadow.ray);
+        if (shadow.light_index == ShadowRay::environment_light)
+                return !shadow_hit.is_hit();
+        return shadow_hit.index == shadow.light_index;
+#endif
+}
+
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+Bounce Scene<WIDTH, HEIGHT, SHAPES>::bounce(uint32_t &seed, const Ray &ray, const ShadingPoint &point, RayCone cone) {
+#ifdef SOA
+        BsdfSample bsdf_sample = m_material_soa.sample(point.material, seed, point.surface);
+#else
+        BsdfSample bsdf_sample = point.material->sample(seed, point.surface);
+#endif
+        if (bsdf_sample.weight == glm::vec3{0})
+                return Bounce{.ray = ray, .cone = cone, .weight = glm::vec3{0}, .bsdf_pdf = 0.0f};
         
-        // Indirect Lighting
-        glm::vec3 target = hit_location + normal + random_unit_vector_pcg(seed);
-        auto new_ray = Ray(hit_location + normal * 0.001f, target - hit_location);
+        // Offset to whichever side the sampled direction leaves from, refracted rays continue through the surface
+        float side = glm::dot(bsdf_sample.direction, point.normal) > 0.0f ? 1.0f : -1.0f;
+        // Specular bounces keep the cone's spread, rough ones widen it to roughly the angular extent of their lobe
+        float spread = bsdf_sample.is_specular ? cone.spread : glm::min(cone.spread + 1.0f / sqrtf(glm::max(bsdf_sample.pdf, 1e-4f)), std::numbers::pi_v<float>);
+        return Bounce{
+                .ray = Ray(point.position + point.normal * (0.001f * side), bsdf_sample.direction),
+                .cone = RayCone{.width = point.cone_width, .spread = spread},
+                .weight = bsdf_sample.weight,
+                .bsdf_pdf = bsdf_sample.is_specular ? 0.0f : bsdf_sample.pdf,
+        };
+}
+
+// bsdf_pdf is the solid angle pdf the previous bounce sampled this ray with, 0 for camera rays and specular bounces
+// which next event estimation cannot reach, so emitters they hit are counted in full rather than MIS weighted.
+// cone tracks the ray's footprint for texture filtering, the default cone always picks the finest mip level.
+// caustic is CausticState::CameraRay for camera rays when light paths are traced as well, see CausticState.
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+glm::vec3 Scene<WIDTH, HEIGHT, SHAPES>::sample(uint32_t &seed, Ray &&ray, int recursion_depth, float bsdf_pdf, RayCone cone, CausticState caustic) {
+        if (recursion_depth <= 0) // Return miss color when recursion depth is exceeded
+                return glm::vec3{0};
+
+#ifdef SOA
+        HitBuffer hit = intersectSoA(ray);
+#else
+        HitBuffer hit = intersectWorld(ray);
+#endif
+        if (!hit.is_hit()) // Return environment radiance on miss
+                return escaped(ray, bsdf_pdf);
+        if (is_emitter(hit))
+                return splatted(hit, caustic) ? glm::vec3{0} : emitted(ray, hit, bsdf_pdf);
         
-        float cos_theta = glm::max(glm::dot(new_ray.direction, normal), 0.0f);
-        glm::vec3 brdf = color * cos_theta;
+        ShadingPoint point = shade(ray, hit, cone);
         
-        glm::vec3 reflected = sample(seed, Ray(hit_location, target - hit_location), recursion_depth - 1, samples_obtained);
-        samples_obtained++;
+        // Next event estimation
+        glm::vec3 next_event_color{0};
+        next_event_estimate(seed, point, [&](const ShadowRay &shadow) {
+                if (unoccluded(shadow))
+                        next_event_color += shadow.contribution;
+        });
+        
+        // Indirect Lighting
+        Bounce next = bounce(seed, ray, point, cone);
+        if (next.weight == glm::vec3{0})
+                return next_event_color;
+        glm::vec3 reflected = sample(seed, std::move(next.ray), recursion_depth - 1, next.bsdf_pdf, next.cone, next_caustic_state(caustic, point.is_specular));
         
-        return next_event_color / 255.0f + (brdf * reflected) / 255.0f;
+        return next_event_color + next.weight * reflected;
 }
 
-template<uint32_t WIDTH, uint32_t HEIGHT>
-void Scene<WIDTH, HEIGHT>::traceScanline(uint32_t v, int recursion_depth) {
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+void Scene<WIDTH, HEIGHT, SHAPES>::traceScanline(uint32_t v, int recursion_depth, int samples) {
         for (uint32_t x = 0; x < WIDTH; x++) {
                 glm::vec3 pixel_color{};
-                uint32_t samples_obtained = 0;
-                uint32_t seed = x + v * WIDTH;
+                uint32_t seed = x + v * WIDTH + m_seed_offset;
                 
-                for (int s = 0; s < sample_count; ++s) {
-                        auto light = sample(seed, m_camera.get_ray(glm::vec2{x + random_pcg(seed), v + random_pcg(seed)} / glm::vec2{WIDTH, HEIGHT}), recursion_depth, samples_obtained);
-                        pixel_color += light;
+                for (int s = 0; s < samples; ++s) {
+                        auto light = sample(seed, m_camera.get_ray(glm::vec2{x + random_pcg(seed), v + random_pcg(seed)} / glm::vec2{WIDTH, HEIGHT}), recursion_depth, 0.0f, m_camera.pixel_cone(HEIGHT), camera_caustic_state());
+                        pixel_color += clamped(light);
                 }
                 
-                pixel_color /= float(samples_obtained);
-                if (glm::length(pixel_color) > 5.0f) // Write bright pixels to the bloom buffer
-                        m_bloom_image.set(x, v, pixel_color);
-                else
-                        m_bloom_image.set(x, v, {0, 0, 0});
-                m_image.set(x, v, pixel_color);
+                store(x, v, pixel_color / float(samples));
         }
 }
 
-template<uint32_t WIDTH, uint32_t HEIGHT>
-void Scene<WIDTH, HEIGHT>::render() {
+#ifdef SOA
+// Traces the same paths as traceScanline for rows [first_row, first_row + rows), but breadth first: one sample of every
+// pixel is advanced a bounce at a time. Each bounce's rays are sorted by ray_sort_key before they are intersected, the
+// hits are sorted again by hit point before they are shaded, so texture and mesh lookups of nearby hits run together,
+// and the shadow rays they spawn are sorted before they are traced. Each path keeps its own seed, so the image matches
+// traceScanline up to floating point summation order.
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+void Scene<WIDTH, HEIGHT, SHAPES>::traceRowsSorted(uint32_t first_row, uint32_t rows, int recursion_depth, int samples) {
+        struct Path {
+                Ray ray;
+                RayCone cone;
+                glm::vec3 throughput;
+                float bsdf_pdf;
+                CausticState caustic;
+                uint32_t seed;
+                uint32_t pixel; // index into the rows being traced
+        };
+        struct PathHit {
+                Path path;
+                HitBuffer hit;
+        };
+        struct PendingShadowRay {
+                ShadowRay shadow;
+                glm::vec3 throughput;
+                uint32_t pixel;
+        };
+        
+        rows = std::min(rows, HEIGHT - first_row);
+        std::vector<glm::vec3> pixel_colors(WIDTH * rows, glm::vec3{0});
+        std::vector<glm::vec3> sample_colors(WIDTH * rows, glm::vec3{0}); // the current sample, clamped as a whole
+        std::vector<uint32_t> seeds(WIDTH * rows);
+        for (uint32_t pixel = 0; pixel < WIDTH * rows; pixel++)
+                seeds[pixel] = pixel + first_row * WIDTH + m_seed_offset;
+        
+        std::vector<Path> paths, next_paths;
+        std::vector<PathHit> path_hits;
+        std::vector<PendingShadowRay> shadow_rays;
+        RaySortBuffers<Path> path_buffers;
+        RaySortBuffers<PathHit> hit_buffers;
+        RaySortBuffers<PendingShadowRay> shadow_buffers;
+        uint64_t rays = 0, ray_hits = 0, shadow_ray_count = 0, shadow_rays_unoccluded = 0, batches = 0;
+        
+        for (int s = 0; s < samples; ++s) {
+                paths.clear();
+                for (uint32_t pixel = 0; pixel < WIDTH * rows; pixel++) {
+                        uint32_t &seed = seeds[pixel];
+                        uint32_t x = pixel % WIDTH, v = first_row + pixel / WIDTH;
+                        Ray camera_ray = m_camera.get_ray(glm::vec2{x + random_pcg(seed), v + random_pcg(seed)} / glm::vec2{WIDTH, HEIGHT});
+                        paths.push_back(Path{.ray = camera_ray, .cone = m_camera.pixel_cone(HEIGHT), .throughput = glm::vec3{1}, .bsdf_pdf = 0.0f, .caustic = camera_caustic_state(), .seed = seed, .pixel = pixel});
+                }
+                
+                for (int depth = recursion_depth; depth > 0 && !paths.empty(); depth--) {
+                        // Camera rays are coherent already, only the bounces are sorted
+                        if (depth != recursion_depth)
+                                sort_by_ray(paths, [](const Path &path) -> const Ray & { return path.ray; }, path_buffers);
+                        next_paths.clear();
+                        path_hits.clear();
+                        shadow_rays.clear();
+                        batches++;
+                        
+                        for (Path &path: paths) {
+                                HitBuffer hit = intersectSoA(path.ray);
+                                rays++;
+                                if (!hit.is_hit()) {
+                                        sample_colors[path.pixel] += path.throughput * escaped(path.ray, path.bsdf_pdf);
+                                        seeds[path.pixel] = path.seed;
+                                        continue;
+                                }
+                                ray_hits++;
+                                if (is_emitter(hit)) {
+                                        if (!splatted(hit, path.caustic))
+                                                sample_colors[path.pixel] += path.throughput * emitted(path.ray, hit, path.bsdf_pdf);
+                                        seeds[path.pixel] = path.seed;
+                                        continue;
+                                }
+                                path_hits.push_back(PathHit{.path = path, .hit = hit});
+                        }
+                        
+                        sort_by_ray(path_hits, [](const PathHit &path_hit) { return Ray(path_hit.path.ray.at(path_hit.hit.distance), path_hit.path.ray.direction); }, hit_buffers);
+                        for (PathHit &path_hit: path_hits) {
+                                Path &path = path_hit.path;
+                                ShadingPoint point = shade(path.ray, path_hit.hit, path.cone);
+                                next_event_estimate(path.seed, point, [&](const ShadowRay &shadow) {
+                                        shadow_rays.push_back(PendingShadowRay{.shadow = shadow, .throughput = path.throughput, .pixel = path.pixel});
+                                });
+                                Bounce next = bounce(path.seed, path.ray, point, path.cone);
+                                if (next.weight == glm::vec3{0}) {
+                                        seeds[path.pixel] = path.seed;
+                                        continue;
+                                }
+                                next_paths.push_back(Path{.ray = next.ray, .cone = next.cone, .throughput = path.throughput * next.weight, .bsdf_pdf = next.bsdf_pdf, .caustic = next_caustic_state(path.caustic, point.is_specular), .seed = path.seed, .pixel = path.pixel});
+                        }
+                        
+                        sort_by_ray(shadow_rays, [](const PendingShadowRay &pending) -> const Ray & { return pending.shadow.ray; }, shadow_buffers);
+                        for (const PendingShadowRay &pending: shadow_rays) {
+                                if (unoccluded(pending.shadow)) {
+                                        sample_colors[pending.pixel] += pending.throughput * pending.shadow.contribution;
+                                        shadow_rays_unoccluded++;
+                                }
+                        }
+                        shadow_ray_count += shadow_rays.size();
+                        std::swap(paths, next_paths);
+                }
+                for (const Path &path: paths) // Cut off by the recursion depth
+                        seeds[path.pixel] = path.seed;
+                for (uint32_t pixel = 0; pixel < WIDTH * rows; pixel++) {
+                        pixel_colors[pixel] += clamped(sample_colors[pixel]);
+                        sample_colors[pixel] = glm::vec3{0};
+                }
+        }
+        
+        m_ray_statistics.rays += rays;
+        m_ray_statistics.ray_hits += ray_hits;
+        m_ray_statistics.shadow_rays += shadow_ray_count;
+        m_ray_statistics.shadow_rays_unoccluded += shadow_rays_unoccluded;
+        m_ray_statistics.batches += batches;
+        
+        for (uint32_t pixel = 0; pixel < WIDTH * rows; pixel++)
+                store(pixel % WIDTH, first_row + pixel / WIDTH, pixel_colors[pixel] / float(samples));
+}
+
+// Traces count light paths out of the circle lights, picked in proportion to their power, continuing seed. Only paths
+// whose first bounce is specular are followed, every non specular vertex after that is connected to the camera and
+// splatted into m_splat_image, the caustics camera paths leave out. The splats are not normalised, divide them by the
+// number of light paths traced per pixel.
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+void Scene<WIDTH, HEIGHT, SHAPES>::traceLightPaths(uint32_t &seed, uint32_t count, int recursion_depth) {
+        std::vector<uint32_t> light_indices;
+        std::vector<float> light_powers;
+        m_shape_soa.for_each_circle_light([&](uint32_t light_index, const Circle &light) {
+                glm::vec3 emitted = m_shape_soa.color(ShapeType::Circle, light_index) * m_shape_soa.intensity(ShapeType::Circle, light_index) / 255.0f;
+                light_indices.push_back(light_index);
+                light_powers.push_back(glm::dot(emitted, glm::vec3{0.2126f, 0.7152f, 0.0722f}) * light.surface_area());
+        });
+        AliasTable light_selection(light_powers);
+        if (light_selection.total() <= 0.0f)
+                return;
+        
+        for (uint32_t i = 0; i < count; i++) {
+                uint32_t selected = light_selection.sample(random_pcg(seed));
+                uint32_t light_index = light_indices[selected];
+                const Circle &light = m_shape_soa.circles[light_index];
+                EmissionSample emission = light.sample_emission(seed);
+                glm::vec3 emitted = m_shape_soa.color(ShapeType::Circle, light_index) * m_shape_soa.intensity(ShapeType::Circle, light_index) / 255.0f;
+                glm::vec3 throughput = emitted * std::numbers::pi_v<float> * emission.area / light_selection.pmf(selected);
+                
+                Ray ray = emission.ray;
+                for (int depth = 0; depth < recursion_depth; depth++) {
+                        HitBuffer hit = intersectSoA(ray);
+                        if (!hit.is_hit() || is_emitter(hit))
+                                break;
+                        
+                        ShadingPoint point = shade(ray, hit, RayCone{});
+                        if (depth == 0 && !point.is_specular)
+                                break; // Not a caustic, camera paths gather everything this path could splat
+                        
+                        if (!point.is_specular) {
+                                CameraConnection connection = m_camera.connect(point.position);
+                                // surface.wo faces the light, the BSDF is symmetric so it is evaluated with the roles swapped
+                                glm::vec3 bsdf = connection.importance > 0.0f ? m_material_soa.evaluate(point.material, point.surface, connection.direction) : glm::vec3{0};
+                                if (bsdf != glm::vec3{0}) {
+                                        HitBuffer blocker = intersectSoA(Ray(point.position + point.normal * 0.001f, connection.direction));
+                                        if (!blocker.is_hit() || blocker.distance >= connection.distance)
+                                                m_splat_image.splat(connection.uv, clamped(throughput * bsdf * connection.importance));
+                                }
+                        }
+                        
+                        Bounce next = bounce(seed, ray, point, RayCone{});
+                        if (next.weight == glm::vec3{0})
+                                break;
+                        throughput *= next.weight;
+                        ray = next.ray;
+                }
+        }
+}
+#endif
+
+// Renders every pixel from scratch into m_image with samples camera paths, plus as many light paths per pixel when
+// m_trace_light_paths is set
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+void Scene<WIDTH, HEIGHT, SHAPES>::render(int samples) {
         BS::thread_pool pool(12);
         
+#ifdef SOA
+        if (m_sort_secondary_rays) {
+                for (uint32_t y = 0; y < HEIGHT; y += sorted_batch_rows())
+                        pool.push_task(&Scene<WIDTH, HEIGHT, SHAPES>::traceRowsSorted, this, y, sorted_batch_rows(), recurse_depth, samples);
+        } else {
+                for (uint32_t y = 0; y < HEIGHT; y++)
+                        pool.push_task(&Scene<WIDTH, HEIGHT, SHAPES>::traceScanline, this, y, recurse_depth, samples);
+        }
+#else
         for (uint32_t y = 0; y < HEIGHT; y++)
-                pool.push_task(&Scene<WIDTH, HEIGHT>::traceScanline, this, y, recurse_depth);
+                pool.push_task(&Scene<WIDTH, HEIGHT, SHAPES>::traceScanline, this, y, recurse_depth, samples);
+#endif
+#ifdef SOA
+        // As many light paths as camera samples, each task splats wherever its paths land
+        if (m_trace_light_paths) {
+                m_splat_image.clear();
+                for (uint32_t y = 0; y < HEIGHT; y++) {
+                        pool.push_task([this, y, samples] {
+                                uint32_t seed = pcg_hash(m_seed_offset + WIDTH * HEIGHT + y);
+                                traceLightPaths(seed, WIDTH * samples, recurse_depth);
+                        });
+                }
+        }
+#endif
         pool.wait_for_tasks();
+        
+#ifdef SOA
+        if (m_trace_light_paths)
+                for (uint32_t y = 0; y < HEIGHT; y++)
+                        for (uint32_t x = 0; x < WIDTH; x++)
+                                store(x, y, m_image.data()[y * WIDTH + x] + m_splat_image.get(x, y) / float(samples));
+#endif
 }
 
 #ifndef SOA
-template<uint32_t WIDTH, uint32_t HEIGHT>
-void Scene<WIDTH, HEIGHT>::addShape(const Shape &shape, glm::vec3 color, float intensity) noexcept {
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+void Scene<WIDTH, HEIGHT, SHAPES>::addShape(const Shape &shape, glm::vec3 color, float intensity, const Material &material, TextureHandle texture) noexcept {
         m_shapes.emplace_back(shape);
         m_colors.emplace_back(color);
         m_intensities.emplace_back(intensity);
+        m_materials.emplace_back(material);
+        m_textures.emplace_back(texture);
         if (intensity > std::numeric_limits<float>::epsilon())
                 m_light_indices.push_back(m_shapes.size() - 1);
 }
-template<uint32_t WIDTH, uint32_t HEIGHT>
-void Scene<WIDTH, HEIGHT>::addShape(Shape &&shape, glm::vec3 color, float intensity) noexcept {
+template<uint32_t WIDTH, uint32_t HEIGHT, typename SHAPES>
+void Scene<WIDTH, HEIGHT, SHAPES>::addShape(Shape &&shape, glm::vec3 color, float intensity, const Material &material, TextureHandle texture) noexcept {
         m_shapes.emplace_back(shape);
         m_colors.emplace_back(color);
         m_intensities.emplace_back(intensity);
+        m_materials.emplace_back(material);
+        m_textures.emplace_back(texture);
         if (intensity > std::numeric_limits<float>::epsilon())
                 m_light_indices.push_back(m_shapes.size() - 1);
 }
@@ -1,18 +1,24 @@
 #include "shape.h"
+#include <numbers>
 #include <glm/gtx/norm.hpp>
 #include "raytracer_random.h"
 
 static constexpr float miss_value = std::numeric_limits<float>::max();
 static constexpr float epsilon = std::numeric_limits<float>::epsilon();
+static constexpr float min_distance = 0.001f; // matches the self intersection cutoff used when searching for the closest hit
 
-Triangle::Triangle(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3) : m_p1(p1), m_p2(p2), m_p3(p3) {
 #ifndef SOA
+Triangle::Triangle(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3) : m_p1(p1), m_p2(p2), m_p3(p3) {
         glm::vec3 edge1 = m_p2 - m_p1;
         glm::vec3 edge2 = m_p3 - m_p1;
         m_normal = glm::normalize(glm::cross(edge1, edge2));
-#endif
 }
+#endif
 float Triangle::intersect_impl(const Ray &ray) const noexcept {
+        glm::vec2 barycentrics;
+        return intersect_impl(ray, barycentrics);
+}
+float Triangle::intersect_impl(const Ray &ray, glm::vec2 &barycentrics) const noexcept {
         glm::vec3 edge1 = m_p2 - m_p1;
         glm::vec3 edge2 = m_p3 - m_p1;
         glm::vec3 h = glm::cross(ray.direction, edge2);
@@ -33,8 +39,10 @@ float Triangle::intersect_impl(const Ray &ray) const noexcept {
                 return miss_value; // Intersection is outside the triangle.
         
         float t = f * glm::dot(edge2, q);
-        if (t > epsilon)
+        if (t > epsilon) {
+                barycentrics = {u, v}; // Weights of m_p2 and m_p3
                 return t; // Intersection exists and is within the triangle.
+        }
         
         return miss_value; // Intersection is behind the ray origin.
 }
@@ -61,18 +69,49 @@ glm::vec3 Triangle::random_point_impl(uint32_t seed, glm::vec3) const noexcept {
         
         return rand1 * m_p1 + rand2 * m_p2 + rand3 * m_p3;
 }
-#ifdef SOA
+bool Triangle::front_face_impl(const Ray &ray, float) const noexcept {
+        return glm::dot(ray.direction, calculate_normal()) < 0.0f;
+}
+LightSample Triangle::sample_light_impl(uint32_t &seed, glm::vec3 world_point) const noexcept {
+        glm::vec3 point = random_point_impl(seed, world_point);
+        seed = pcg_hash(seed); // random_point_impl takes the seed by value, advance it so the next sample differs
+        
+        glm::vec3 offset = point - world_point;
+        float distance = glm::length(offset);
+        glm::vec3 direction = offset / distance;
+        return LightSample{.direction = direction, .distance = distance, .pdf = light_pdf_impl(Ray(world_point, direction), distance)};
+}
+float Triangle::light_pdf_impl(const Ray &ray, float distance) const noexcept {
+        glm::vec3 cross = glm::cross(m_p2 - m_p1, m_p3 - m_p1);
+        float area = 0.5f * glm::length(cross);
+        float cos_light = std::abs(glm::dot(ray.direction, cross / (2.0f * area)));
+        if (cos_light < epsilon)
+                return 0.0f;
+        return distance * distance / (area * cos_light); // Uniform area density converted to solid angle
+}
+glm::vec2 Triangle::uv_impl(const Ray &, float, glm::vec2 barycentrics) const noexcept {
+        return barycentrics; // m_p1, m_p2 and m_p3 map to (0, 0), (1, 0) and (0, 1)
+}
+float Triangle::uv_density_impl() const noexcept {
+        float area = 0.5f * glm::length(glm::cross(m_p2 - m_p1, m_p3 - m_p1));
+        return sqrtf(0.5f / area);
+}
 glm::vec3 Triangle::calculate_normal() const noexcept {
         glm::vec3 edge1 = m_p2 - m_p1;
         glm::vec3 edge2 = m_p3 - m_p1;
         return glm::normalize(glm::cross(edge1, edge2));
 }
-#endif
-
+glm::vec2 triangle_uv(const TriangleUVs &uvs, glm::vec2 barycentrics) noexcept {
+        return (1.0f - barycentrics.x - barycentrics.y) * uvs[0] + barycentrics.x * uvs[1] + barycentrics.y * uvs[2];
+}
+float triangle_uv_density(const Triangle &triangle, const TriangleUVs &uvs) noexcept {
+        glm::vec2 uv_edge1 = uvs[1] - uvs[0];
+        glm::vec2 uv_edge2 = uvs[2] - uvs[0];
+        float uv_area = 0.5f * std::abs(uv_edge1.x * uv_edge2.y - uv_edge1.y * uv_edge2.x);
+        return triangle.uv_density() * sqrtf(uv_area / 0.5f); // Triangle::uv_density assumes default_triangle_uvs
+}
 
-Circle::Circle(glm::vec3 center, float radius) : m_center(center), m_radius(radius) {
 
-}
 float Circle::intersect_impl(const Ray &ray) const noexcept {
         glm::vec3 oc = ray.origin - m_center;
         auto a = glm::length2(ray.direction);
@@ -82,7 +121,14 @@ float Circle::intersect_impl(const Ray &ray) const noexcept {
         
         if (discriminant < 0)
                 return miss_value;
-        return (-half_b - sqrtf(discriminant)) / a;
+        
+        float t = (-half_b - sqrtf(discriminant)) / a;
+        if (t < min_distance) // Ray starts inside the sphere, e.g. after refracting into it
+                t = (-half_b + sqrtf(discriminant)) / a;
+        return t;
+}
+float Circle::intersect_impl(const Ray &ray, glm::vec2 &) const noexcept {
+        return intersect_impl(ray);
 }
 glm::vec3 Circle::normal_impl(const Ray &ray, float distance) const noexcept {
         glm::vec3 hit_point = ray.at(distance);
@@ -96,11 +142,45 @@ glm::vec3 Circle::position_impl() const noexcept {
 glm::vec3 Circle::random_point_impl(uint32_t seed, glm::vec3 direction_to_world_point) const noexcept {
         return m_center + m_radius * random_vector_in_cone(seed, direction_to_world_point, 0.5f);
 }
+bool Circle::front_face_impl(const Ray &ray, float distance) const noexcept {
+        return glm::dot(ray.direction, ray.at(distance) - m_center) < 0.0f;
+}
+LightSample Circle::sample_light_impl(uint32_t &seed, glm::vec3 world_point) const noexcept {
+        float pdf = light_pdf_impl(Ray(world_point, m_center - world_point), 0.0f);
+        if (pdf <= 0.0f)
+                return LightSample{.direction = glm::vec3{0}, .distance = 0.0f, .pdf = 0.0f};
+        
+        // Sample the cone of directions subtended by the sphere, every one of them hits it
+        float sin2_theta_max = m_radius * m_radius / glm::length2(m_center - world_point);
+        glm::vec3 direction = random_vector_in_solid_cone(seed, glm::normalize(m_center - world_point), sqrtf(1.0f - sin2_theta_max));
+        return LightSample{.direction = direction, .distance = intersect_impl(Ray(world_point, direction)), .pdf = pdf};
+}
+float Circle::light_pdf_impl(const Ray &ray, float) const noexcept {
+        float sin2_theta_max = m_radius * m_radius / glm::length2(m_center - ray.origin);
+        if (sin2_theta_max >= 1.0f)
+                return 0.0f; // Inside the sphere
+        
+        float one_minus_cos_theta_max = sin2_theta_max / (1.0f + sqrtf(1.0f - sin2_theta_max)); // Stable for small, distant lights
+        return 1.0f / (2.0f * std::numbers::pi_v<float> * one_minus_cos_theta_max);
+}
+glm::vec2 Circle::uv_impl(const Ray &ray, float distance, glm::vec2) const noexcept {
+        glm::vec3 p = glm::clamp((ray.at(distance) - m_center) / m_radius, -1.0f, 1.0f);
+        return {0.5f + atan2f(p.z, p.x) / (2.0f * std::numbers::pi_v<float>), 0.5f + asinf(p.y) / std::numbers::pi_v<float>};
+}
+float Circle::uv_density_impl() const noexcept {
+        return 1.0f / (m_radius * sqrtf(4.0f * std::numbers::pi_v<float>));
+}
+float Circle::surface_area() const noexcept {
+        return 4.0f * std::numbers::pi_v<float> * m_radius * m_radius;
+}
+EmissionSample Circle::sample_emission(uint32_t &seed) const noexcept {
+        glm::vec3 normal = random_unit_vector_pcg(seed);
+        glm::vec3 direction = normal + random_unit_vector_pcg(seed);
+        direction = glm::length2(direction) > 1e-8f ? glm::normalize(direction) : normal;
+        return EmissionSample{.ray = Ray(m_center + normal * (m_radius + 0.001f), direction), .area = surface_area()};
+}
 
 
-Plane::Plane(glm::vec3 normal, float distance) : m_normal(normal), m_distance(distance) {
-
-}
 float Plane::intersect_impl(const Ray &ray) const noexcept {
         const float denom = glm::dot(ray.direction, m_normal);
         if (std::abs(denom) < epsilon)
@@ -112,6 +192,9 @@ float Plane::intersect_impl(const Ray &ray) const noexcept {
         
         return t;
 }
+float Plane::intersect_impl(const Ray &ray, glm::vec2 &) const noexcept {
+        return intersect_impl(ray);
+}
 glm::vec3 Plane::normal_impl(const Ray &ray, float distance) const noexcept {
         return glm::dot(ray.direction, m_normal) > epsilon ? -m_normal : m_normal;
 }
@@ -120,4 +203,20 @@ glm::vec3 Plane::position_impl() const noexcept {
 }
 glm::vec3 Plane::random_point_impl(uint32_t seed, glm::vec3) const noexcept {
         return glm::vec3();
+}
+bool Plane::front_face_impl(const Ray &ray, float) const noexcept {
+        return glm::dot(ray.direction, m_normal) < 0.0f;
+}
+LightSample Plane::sample_light_impl(uint32_t &, glm::vec3) const noexcept {
+        return LightSample{.direction = glm::vec3{0}, .distance = 0.0f, .pdf = 0.0f}; // Infinite planes have no finite area to sample
+}
+float Plane::light_pdf_impl(const Ray &, float) const noexcept {
+        return 0.0f;
+}
+glm::vec2 Plane::uv_impl(const Ray &ray, float distance, glm::vec2) const noexcept {
+        glm::vec3 hit_point = ray.at(distance);
+        return {glm::dot(hit_point, tangent_to_world({1, 0, 0}, m_normal)), glm::dot(hit_point, tangent_to_world({0, 1, 0}, m_normal))}; // Repeats every world unit
+}
+float Plane::uv_density_impl() const noexcept {
+        return 1.0f;
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <array>
 #include <iostream>
 #include <vector>
 #include <variant>
@@ -13,11 +14,27 @@ struct overloaded : Ts ... {
 template<class... Ts>
 overloaded(Ts...) -> overloaded<Ts...>;
 
+struct LightSample {
+        glm::vec3 direction;
+        float distance;
+        float pdf; // solid angle pdf, 0 when the shape cannot be sampled
+};
+
+// Start of a light path, the point is uniform over the emitting surface and the direction cosine distributed around
+// its normal, so the emitted radiance times pi * area is the path's starting throughput
+struct EmissionSample {
+        Ray ray;
+        float area;
+};
+
 template<typename Impl>
 struct ShapeStruct {
         [[nodiscard]] float intersect(const Ray &ray) const noexcept {
                 return static_cast<const Impl &>(*this).intersect_impl(ray);
         }
+        [[nodiscard]] float intersect(const Ray &ray, glm::vec2 &barycentrics) const noexcept {
+                return static_cast<const Impl &>(*this).intersect_impl(ray, barycentrics);
+        }
         [[nodiscard]] glm::vec3 normal(const Ray &ray, float distance) const noexcept {
                 return static_cast<const Impl &>(*this).normal_impl(ray, distance);
         }
@@ -27,21 +44,44 @@ struct ShapeStruct {
         [[nodiscard]] glm::vec3 random_point(uint32_t seed, glm::vec3 world_point) const noexcept {
                 return static_cast<const Impl &>(*this).random_point_impl(seed, world_point);
         }
+        [[nodiscard]] bool front_face(const Ray &ray, float distance) const noexcept {
+                return static_cast<const Impl &>(*this).front_face_impl(ray, distance);
+        }
+        [[nodiscard]] LightSample sample_light(uint32_t &seed, glm::vec3 world_point) const noexcept {
+                return static_cast<const Impl &>(*this).sample_light_impl(seed, world_point);
+        }
+        [[nodiscard]] float light_pdf(const Ray &ray, float distance) const noexcept {
+                return static_cast<const Impl &>(*this).light_pdf_impl(ray, distance);
+        }
+        [[nodiscard]] glm::vec2 uv(const Ray &ray, float distance, glm::vec2 barycentrics) const noexcept {
+                return static_cast<const Impl &>(*this).uv_impl(ray, distance, barycentrics);
+        }
+        [[nodiscard]] float uv_density() const noexcept {
+                return static_cast<const Impl &>(*this).uv_density_impl();
+        }
 };
 
 
 class Triangle : public ShapeStruct<Triangle> {
 public:  // Public Member Functions
+#ifdef SOA
+        constexpr Triangle(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3) : m_p1(p1), m_p2(p2), m_p3(p3) {}
+#else
         Triangle(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3);
+#endif
 public:  // Public Constructors/Destructors/Overloads
         [[nodiscard]] float intersect_impl(const Ray &ray) const noexcept;
+        [[nodiscard]] float intersect_impl(const Ray &ray, glm::vec2 &barycentrics) const noexcept;
         [[nodiscard]] glm::vec3 normal_impl(const Ray &ray, float distance) const noexcept;
         [[nodiscard]] glm::vec3 position_impl() const noexcept;
         [[nodiscard]] glm::vec3 random_point_impl(uint32_t seed, glm::vec3 world_point) const noexcept;
+        [[nodiscard]] bool front_face_impl(const Ray &ray, float distance) const noexcept;
+        [[nodiscard]] LightSample sample_light_impl(uint32_t &seed, glm::vec3 world_point) const noexcept;
+        [[nodiscard]] float light_pdf_impl(const Ray &ray, float distance) const noexcept;
+        [[nodiscard]] glm::vec2 uv_impl(const Ray &ray, float distance, glm::vec2 barycentrics) const noexcept;
+        [[nodiscard]] float uv_density_impl() const noexcept; // uv units per world unit, scales ray footprints for mip selection
 
-#ifdef SOA
         [[nodiscard]] glm::vec3 calculate_normal() const noexcept;
-#endif
 public:  // Public Member Variables
 private: // Private Member Functions
 private: // Private Member Variablesg
@@ -55,12 +95,21 @@ private: // Private Member Variablesg
 
 class Circle : public ShapeStruct<Circle> {
 public:  // Public Constructors/Destructors/Overloads
-        Circle(glm::vec3 center, float radius);
+        constexpr Circle(glm::vec3 center, float radius) : m_center(center), m_radius(radius) {}
 public:  // Public Member Functions
         [[nodiscard]] float intersect_impl(const Ray &ray) const noexcept;
+        [[nodiscard]] float intersect_impl(const Ray &ray, glm::vec2 &barycentrics) const noexcept;
         [[nodiscard]] glm::vec3 normal_impl(const Ray &ray, float distance) const noexcept;
         [[nodiscard]] glm::vec3 position_impl() const noexcept;
         [[nodiscard]] glm::vec3 random_point_impl(uint32_t seed, glm::vec3 world_point) const noexcept;
+        [[nodiscard]] bool front_face_impl(const Ray &ray, float distance) const noexcept;
+        [[nodiscard]] LightSample sample_light_impl(uint32_t &seed, glm::vec3 world_point) const noexcept;
+        [[nodiscard]] float light_pdf_impl(const Ray &ray, float distance) const noexcept;
+        [[nodiscard]] glm::vec2 uv_impl(const Ray &ray, float distance, glm::vec2 barycentrics) const noexcept;
+        [[nodiscard]] float uv_density_impl() const noexcept; // uv units per world unit, scales ray footprints for mip selection
+        
+        [[nodiscard]] float surface_area() const noexcept;
+        [[nodiscard]] EmissionSample sample_emission(uint32_t &seed) const noexcept;
 public:  // Public Member Variables
 private: // Private Member Functions
         glm::vec3 m_center{};
@@ -70,12 +119,18 @@ public: // Private Member Variables
 
 class Plane : public ShapeStruct<Plane> {
 public:  // Public Constructors/Destructors/Overloads
-        Plane(glm::vec3 normal, float distance);
+        constexpr Plane(glm::vec3 normal, float distance) : m_normal(normal), m_distance(distance) {}
 public:  // Public Member Functions
         [[nodiscard]] float intersect_impl(const Ray &ray) const noexcept;
+        [[nodiscard]] float intersect_impl(const Ray &ray, glm::vec2 &barycentrics) const noexcept;
         [[nodiscard]] glm::vec3 normal_impl(const Ray &ray, float distance) const noexcept;
         [[nodiscard]] glm::vec3 position_impl() const noexcept;
         [[nodiscard]] glm::vec3 random_point_impl(uint32_t seed, glm::vec3 world_point) const noexcept;
+        [[nodiscard]] bool front_face_impl(const Ray &ray, float distance) const noexcept;
+        [[nodiscard]] LightSample sample_light_impl(uint32_t &seed, glm::vec3 world_point) const noexcept;
+        [[nodiscard]] float light_pdf_impl(const Ray &ray, float distance) const noexcept;
+        [[nodiscard]] glm::vec2 uv_impl(const Ray &ray, float distance, glm::vec2 barycentrics) const noexcept;
+        [[nodiscard]] float uv_density_impl() const noexcept; // uv units per world unit, scales ray footprints for mip selection
 public:  // Public Member Variables
 private: // Private Member Functions
         glm::vec3 m_normal{};
@@ -83,6 +138,13 @@ private: // Private Member Functions
 private: // Private Member Variables
 };
 
+// Per corner uvs of a triangle, for storages which keep them next to their triangles
+using TriangleUVs = std::array<glm::vec2, 3>;
+inline constexpr TriangleUVs default_triangle_uvs{glm::vec2{0, 0}, glm::vec2{1, 0}, glm::vec2{0, 1}}; // what Triangle::uv maps to
+
+[[nodiscard]] glm::vec2 triangle_uv(const TriangleUVs &uvs, glm::vec2 barycentrics) noexcept;
+[[nodiscard]] float triangle_uv_density(const Triangle &triangle, const TriangleUVs &uvs) noexcept;
+
 class Shape : public std::variant<Triangle, Circle, Plane> {
 public:  // Public Constructors/Destructors/Overloads
         using variant<Triangle, Circle, Plane>::variant;
@@ -90,6 +152,10 @@ public:  // Public Member Functions
         [[nodiscard]] float intersect(const Ray &ray) const noexcept {
                 return std::visit([ray](auto &&shape) { return shape.intersect(ray); }, *this);
         }
+        
+        [[nodiscard]] float intersect(const Ray &ray, glm::vec2 &barycentrics) const noexcept {
+                return std::visit([ray, &barycentrics](auto &&shape) { return shape.intersect(ray, barycentrics); }, *this);
+        }
 
         [[nodiscard]] glm::vec3 normal(const Ray &ray, float distance) const noexcept {
                 return std::visit([ray, distance](auto &&shape) { return shape.normal(ray, distance); }, *this);
@@ -102,4 +168,24 @@ public:  // Public Member Functions
         [[nodiscard]] glm::vec3 random_point(uint32_t seed, glm::vec3 world_point) const noexcept {
                 return std::visit([seed, world_point](auto &&shape) { return shape.random_point(seed, world_point); }, *this);
         }
+        
+        [[nodiscard]] bool front_face(const Ray &ray, float distance) const noexcept {
+                return std::visit([ray, distance](auto &&shape) { return shape.front_face(ray, distance); }, *this);
+        }
+        
+        [[nodiscard]] LightSample sample_light(uint32_t &seed, glm::vec3 world_point) const noexcept {
+                return std::visit([&seed, world_point](auto &&shape) { return shape.sample_light(seed, world_point); }, *this);
+        }
+        
+        [[nodiscard]] float light_pdf(const Ray &ray, float distance) const noexcept {
+                return std::visit([ray, distance](auto &&shape) { return shape.light_pdf(ray, distance); }, *this);
+        }
+        
+        [[nodiscard]] glm::vec2 uv(const Ray &ray, float distance, glm::vec2 barycentrics) const noexcept {
+                return std::visit([ray, distance, barycentrics](auto &&shape) { return shape.uv(ray, distance, barycentrics); }, *this);
+        }
+        
+        [[nodiscard]] float uv_density() const noexcept {
+                return std::visit([](auto &&shape) { return shape.uv_density(); }, *this);
+        }
 };
@@ -1,11 +1,16 @@
 #pragma once
 #include "shape.h"
+#include "material_soa.h"
+#include "texture.h"
+#include "mesh.h"
+#include <memory_resource>
+#include <span>
 
 
 #ifdef SOA
 
 enum class ShapeType {
-        Circle, Triangle, Plane
+        Circle, Triangle, Plane, Mesh
 };
 #endif
 
@@ -15,117 +20,364 @@ struct HitBuffer {
 #ifdef SOA
         ShapeType shape_type;
 #endif
+        glm::vec2 barycentrics{}; // only written for triangles
+        uint32_t primitive = 0;   // triangle within a mesh
         [[nodiscard]] bool is_hit() const { return distance > 0.0001f && distance < std::numeric_limits<float>::max(); };
 };
 
+class ShapeSoA; // Default shape storage of Scene, only defined in SOA builds
+
 #ifdef SOA
 
+// Primitive counts a ShapeSoA is reserved for before a bulk build
+struct ShapeCounts {
+        size_t circles = 0;
+        size_t triangles = 0;
+        size_t planes = 0;
+        size_t meshes = 0;
+};
+
+// Shading accessors shared by every shape storage. Impl keeps one array per shape type and field under the names
+// ShapeSoA uses (circles, m_circle_colors, m_triangle_uvs, ...), as vectors, spans or std::arrays. Storages without
+// meshes (BakedShapeSoA) leave out the mesh arrays, and a ShapeType::Mesh reaching them gets the fallback values.
+template<typename Impl>
+struct ShapeAccessors {
+        [[nodiscard]] glm::vec3 color(ShapeType shape_type, uint32_t index) const noexcept {
+                switch (shape_type) {
+                        case ShapeType::Circle:
+                                return shapes().m_circle_colors[index];
+                        case ShapeType::Triangle:
+                                return shapes().m_triangle_colors[index];
+                        case ShapeType::Plane:
+                                return shapes().m_plane_colors[index];
+                        case ShapeType::Mesh:
+                                if constexpr (has_meshes())
+                                        return shapes().m_mesh_colors[index];
+                                break;
+                }
+                return glm::vec3{0};
+        }
+        
+        [[nodiscard]] float intensity(ShapeType shape_type, uint32_t index) const noexcept {
+                switch (shape_type) {
+                        case ShapeType::Circle:
+                                return shapes().m_circle_intensities[index];
+                        case ShapeType::Triangle:
+                                return shapes().m_triangle_intensities[index];
+                        case ShapeType::Plane:
+                                return shapes().m_plane_intensities[index];
+                        case ShapeType::Mesh:
+                                if constexpr (has_meshes())
+                                        return shapes().m_mesh_intensities[index];
+                                break;
+                }
+                return 0.0f;
+        }
+        
+        [[nodiscard]] MaterialHandle material(ShapeType shape_type, uint32_t index) const noexcept {
+                switch (shape_type) {
+                        case ShapeType::Circle:
+                                return shapes().m_circle_materials[index];
+                        case ShapeType::Triangle:
+                                return shapes().m_triangle_materials[index];
+                        case ShapeType::Plane:
+                                return shapes().m_plane_materials[index];
+                        case ShapeType::Mesh:
+                                if constexpr (has_meshes())
+                                        return shapes().m_mesh_materials[index];
+                                break;
+                }
+                return {};
+        }
+        
+        [[nodiscard]] TextureHandle texture(ShapeType shape_type, uint32_t index) const noexcept {
+                switch (shape_type) {
+                        case ShapeType::Circle:
+                                return shapes().m_circle_textures[index];
+                        case ShapeType::Triangle:
+                                return shapes().m_triangle_textures[index];
+                        case ShapeType::Plane:
+                                return shapes().m_plane_textures[index];
+                        case ShapeType::Mesh:
+                                if constexpr (has_meshes())
+                                        return shapes().m_mesh_textures[index];
+                                break;
+                }
+                return {};
+        }
+        
+        [[nodiscard]] glm::vec2 uv(ShapeType shape_type, uint32_t index, const Ray &ray, float distance, glm::vec2 barycentrics, uint32_t primitive = 0) const noexcept {
+                switch (shape_type) {
+                        case ShapeType::Circle:
+                                return shapes().circles[index].uv(ray, distance, barycentrics);
+                        case ShapeType::Triangle:
+                                return triangle_uv(shapes().m_triangle_uvs[index], barycentrics);
+                        case ShapeType::Plane:
+                                return shapes().planes[index].uv(ray, distance, barycentrics);
+                        case ShapeType::Mesh:
+                                if constexpr (has_meshes())
+                                        return shapes().meshes[index].uv(primitive, barycentrics);
+                                break;
+                }
+                return barycentrics;
+        }
+        
+        [[nodiscard]] float uv_density(ShapeType shape_type, uint32_t index, uint32_t primitive = 0) const noexcept {
+                switch (shape_type) {
+                        case ShapeType::Circle:
+                                return shapes().circles[index].uv_density();
+                        case ShapeType::Triangle:
+                                return triangle_uv_density(shapes().triangles[index], shapes().m_triangle_uvs[index]);
+                        case ShapeType::Plane:
+                                return shapes().planes[index].uv_density();
+                        case ShapeType::Mesh:
+                                if constexpr (has_meshes())
+                                        return shapes().meshes[index].uv_density(primitive);
+                                break;
+                }
+                return 1.0f;
+        }
+        
+        [[nodiscard]] bool front_face(ShapeType shape_type, uint32_t index, const Ray &ray, float distance, uint32_t primitive = 0) const noexcept {
+                switch (shape_type) {
+                        case ShapeType::Circle:
+                                return shapes().circles[index].front_face(ray, distance);
+                        case ShapeType::Triangle:
+                                return glm::dot(ray.direction, shapes().m_triangle_normals[index]) < 0.0f;
+                        case ShapeType::Plane:
+                                return shapes().planes[index].front_face(ray, distance);
+                        case ShapeType::Mesh:
+                                if constexpr (has_meshes())
+                                        return shapes().meshes[index].front_face(primitive, ray);
+                                break;
+                }
+                return true;
+        }
+        
+        [[nodiscard]] glm::vec3 normal(ShapeType shape_type, uint32_t index, const Ray &ray, float distance, uint32_t primitive = 0) const noexcept {
+                switch (shape_type) {
+                        case ShapeType::Circle:
+                                return shapes().circles[index].normal(ray, distance);
+                        case ShapeType::Triangle: {
+                                glm::vec3 normal = shapes().m_triangle_normals[index];
+                                return glm::dot(ray.direction, normal) > std::numeric_limits<float>::epsilon() ? -normal : normal;
+                        }
+                        case ShapeType::Plane:
+                                return shapes().planes[index].normal(ray, distance);
+                        case ShapeType::Mesh:
+                                if constexpr (has_meshes())
+                                        return shapes().meshes[index].normal(primitive, ray);
+                                break;
+                }
+                return -ray.direction;
+        }
+private: // Private Member Functions
+        [[nodiscard]] const Impl &shapes() const noexcept { return static_cast<const Impl &>(*this); }
+        [[nodiscard]] static constexpr bool has_meshes() noexcept { return requires(const Impl &impl) { impl.meshes; }; }
+};
 
-class ShapeSoA {
+// Mutable shape storage and the builder of FrozenShapeSoA. Every array allocates from one memory resource, so a scene
+// can be built into a std::pmr::monotonic_buffer_resource after reserve() without a single reallocation. Meshes are
+// moved into the same resource on insert, build them with get_allocator() to place their buffers there directly.
+// Copies are deleted as a copied std::pmr::vector would fall back to the default resource behind m_resource's back,
+// and so is move assignment, which keeps the target's resource.
+class ShapeSoA : public ShapeAccessors<ShapeSoA> {
 public:
-        std::vector<Circle> circles;
-        std::vector<Triangle> triangles;
-        std::vector<Plane> planes;
+        explicit ShapeSoA(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) : m_resource(resource) {}
+        ShapeSoA(const ShapeSoA &) = delete;
+        ShapeSoA(ShapeSoA &&) = default;
+        ShapeSoA &operator=(const ShapeSoA &) = delete;
+        ShapeSoA &operator=(ShapeSoA &&) = delete;
+        
+        [[nodiscard]] std::pmr::polymorphic_allocator<> get_allocator() const noexcept { return m_resource; }
         
-        std::vector<glm::vec3> m_circle_colors;
-        std::vector<glm::vec3> m_triangle_colors;
-        std::vector<glm::vec3> m_plane_colors;
-        std::vector<glm::vec3> m_triangle_normals;
+        std::pmr::memory_resource *m_resource;
         
-        std::vector<float> m_circle_intensities;
-        std::vector<float> m_triangle_intensities;
-        std::vector<float> m_plane_intensities;
+        std::pmr::vector<Circle> circles{m_resource};
+        std::pmr::vector<Triangle> triangles{m_resource};
+        std::pmr::vector<Plane> planes{m_resource};
+        std::pmr::vector<TriangleMesh> meshes{m_resource};
         
-        std::vector<uint32_t> m_circle_light_indices;
-        std::vector<uint32_t> m_triangle_light_indices;
-        std::vector<uint32_t> m_plane_light_indices;
+        std::pmr::vector<glm::vec3> m_circle_colors{m_resource};
+        std::pmr::vector<glm::vec3> m_triangle_colors{m_resource};
+        std::pmr::vector<glm::vec3> m_plane_colors{m_resource};
+        std::pmr::vector<glm::vec3> m_mesh_colors{m_resource};
+        std::pmr::vector<glm::vec3> m_triangle_normals{m_resource};
         
-        void insert(const Circle &circle, glm::vec3 color, float intensity) {
+        std::pmr::vector<float> m_circle_intensities{m_resource};
+        std::pmr::vector<float> m_triangle_intensities{m_resource};
+        std::pmr::vector<float> m_plane_intensities{m_resource};
+        std::pmr::vector<float> m_mesh_intensities{m_resource};
+        
+        std::pmr::vector<MaterialHandle> m_circle_materials{m_resource};
+        std::pmr::vector<MaterialHandle> m_triangle_materials{m_resource};
+        std::pmr::vector<MaterialHandle> m_plane_materials{m_resource};
+        std::pmr::vector<MaterialHandle> m_mesh_materials{m_resource};
+        
+        std::pmr::vector<TextureHandle> m_circle_textures{m_resource};
+        std::pmr::vector<TextureHandle> m_triangle_textures{m_resource};
+        std::pmr::vector<TextureHandle> m_plane_textures{m_resource};
+        std::pmr::vector<TextureHandle> m_mesh_textures{m_resource};
+        std::pmr::vector<TriangleUVs> m_triangle_uvs{m_resource};
+        
+        std::pmr::vector<uint32_t> m_circle_light_indices{m_resource};
+        std::pmr::vector<uint32_t> m_triangle_light_indices{m_resource};
+        std::pmr::vector<uint32_t> m_plane_light_indices{m_resource};
+        
+        void insert(const Circle &circle, glm::vec3 color, float intensity, MaterialHandle material = {}, TextureHandle texture = {}) {
                 circles.push_back(circle);
                 m_circle_colors.push_back(color);
                 m_circle_intensities.push_back(intensity);
+                m_circle_materials.push_back(material);
+                m_circle_textures.push_back(texture);
                 if (intensity > 0)
                         m_circle_light_indices.push_back(circles.size() - 1);
         }
-        void insert(Circle &&circle, glm::vec3 color, float intensity) {
+        void insert(Circle &&circle, glm::vec3 color, float intensity, MaterialHandle material = {}, TextureHandle texture = {}) {
                 circles.push_back(circle);
                 m_circle_colors.push_back(color);
                 m_circle_intensities.push_back(intensity);
+                m_circle_materials.push_back(material);
+                m_circle_textures.push_back(texture);
                 if (intensity > 0)
                         m_circle_light_indices.push_back(circles.size() - 1);
         }
         
-        void insert(const Triangle &triangle, glm::vec3 color, float intensity) {
+        void insert(const Triangle &triangle, glm::vec3 color, float intensity, MaterialHandle material = {}, TextureHandle texture = {}) {
                 triangles.push_back(triangle);
                 m_triangle_colors.push_back(color);
                 m_triangle_intensities.push_back(intensity);
+                m_triangle_materials.push_back(material);
+                m_triangle_textures.push_back(texture);
+                m_triangle_uvs.push_back(default_triangle_uvs);
                 m_triangle_normals.push_back(triangle.calculate_normal());
                 if (intensity > 0)
-                        m_triangle_light_indices.push_back(circles.size() - 1);
+                        m_triangle_light_indices.push_back(triangles.size() - 1);
         }
-        void insert(Triangle &&triangle, glm::vec3 color, float intensity) {
+        void insert(Triangle &&triangle, glm::vec3 color, float intensity, MaterialHandle material = {}, TextureHandle texture = {}) {
                 triangles.push_back(triangle);
                 m_triangle_colors.push_back(color);
                 m_triangle_intensities.push_back(intensity);
+                m_triangle_materials.push_back(material);
+                m_triangle_textures.push_back(texture);
+                m_triangle_uvs.push_back(default_triangle_uvs);
                 m_triangle_normals.push_back(triangle.calculate_normal());
                 if (intensity > 0)
-                        m_triangle_light_indices.push_back(circles.size() - 1);
+                        m_triangle_light_indices.push_back(triangles.size() - 1);
+        }
+        
+        void insert(const Triangle &triangle, const TriangleUVs &uvs, glm::vec3 color, float intensity, MaterialHandle material = {}, TextureHandle texture = {}) {
+                insert(triangle, color, intensity, material, texture);
+                m_triangle_uvs.back() = uvs;
         }
         
-        void insert(const Plane &plane, glm::vec3 color, float intensity) {
+        void insert(const Plane &plane, glm::vec3 color, float intensity, MaterialHandle material = {}, TextureHandle texture = {}) {
                 planes.push_back(plane);
                 m_plane_colors.push_back(color);
                 m_plane_intensities.push_back(intensity);
+                m_plane_materials.push_back(material);
+                m_plane_textures.push_back(texture);
                 if (intensity > 0)
-                        m_plane_light_indices.push_back(circles.size() - 1);
+                        m_plane_light_indices.push_back(planes.size() - 1);
         }
-        void insert(Plane &&plane, glm::vec3 color, float intensity) {
+        void insert(Plane &&plane, glm::vec3 color, float intensity, MaterialHandle material = {}, TextureHandle texture = {}) {
                 planes.push_back(plane);
                 m_plane_colors.push_back(color);
                 m_plane_intensities.push_back(intensity);
+                m_plane_materials.push_back(material);
+                m_plane_textures.push_back(texture);
                 if (intensity > 0)
-                        m_plane_light_indices.push_back(circles.size() - 1);
+                        m_plane_light_indices.push_back(planes.size() - 1);
         }
         
-        glm::vec3 color(ShapeType shape_type, uint32_t index) {
-                switch (shape_type) {
-                        case ShapeType::Circle:
-                                return m_circle_colors[index];
-                        case ShapeType::Triangle:
-                                return m_triangle_colors[index];
-                        case ShapeType::Plane:
-                                return m_plane_colors[index];
-                }
+        void reserve(ShapeCounts counts) {
+                circles.reserve(counts.circles);
+                m_circle_colors.reserve(counts.circles);
+                m_circle_intensities.reserve(counts.circles);
+                m_circle_materials.reserve(counts.circles);
+                m_circle_textures.reserve(counts.circles);
+                
+                triangles.reserve(counts.triangles);
+                m_triangle_colors.reserve(counts.triangles);
+                m_triangle_normals.reserve(counts.triangles);
+                m_triangle_intensities.reserve(counts.triangles);
+                m_triangle_materials.reserve(counts.triangles);
+                m_triangle_textures.reserve(counts.triangles);
+                m_triangle_uvs.reserve(counts.triangles);
+                
+                planes.reserve(counts.planes);
+                m_plane_colors.reserve(counts.planes);
+                m_plane_intensities.reserve(counts.planes);
+                m_plane_materials.reserve(counts.planes);
+                m_plane_textures.reserve(counts.planes);
+                
+                meshes.reserve(counts.meshes);
+                m_mesh_colors.reserve(counts.meshes);
+                m_mesh_intensities.reserve(counts.meshes);
+                m_mesh_materials.reserve(counts.meshes);
+                m_mesh_textures.reserve(counts.meshes);
         }
         
-        float intensity(ShapeType shape_type, uint32_t index) {
-                switch (shape_type) {
-                        case ShapeType::Circle:
-                                return m_circle_intensities[index];
-                        case ShapeType::Triangle:
-                                return m_triangle_intensities[index];
-                        case ShapeType::Plane:
-                                return m_plane_intensities[index];
-                }
+        // Bulk inserts, the whole range shares one color, intensity, material and texture
+        void insert(std::span<const Circle> range, glm::vec3 color, float intensity, MaterialHandle material = {}, TextureHandle texture = {}) {
+                uint32_t first = circles.size();
+                circles.insert(circles.end(), range.begin(), range.end());
+                m_circle_colors.insert(m_circle_colors.end(), range.size(), color);
+                m_circle_intensities.insert(m_circle_intensities.end(), range.size(), intensity);
+                m_circle_materials.insert(m_circle_materials.end(), range.size(), material);
+                m_circle_textures.insert(m_circle_textures.end(), range.size(), texture);
+                if (intensity > 0)
+                        for (uint32_t i = first; i < circles.size(); i++)
+                                m_circle_light_indices.push_back(i);
+        }
+        void insert(std::span<const Triangle> range, glm::vec3 color, float intensity, MaterialHandle material = {}, TextureHandle texture = {}) {
+                uint32_t first = triangles.size();
+                triangles.insert(triangles.end(), range.begin(), range.end());
+                for (const Triangle &triangle: range)
+                        m_triangle_normals.push_back(triangle.calculate_normal());
+                m_triangle_colors.insert(m_triangle_colors.end(), range.size(), color);
+                m_triangle_intensities.insert(m_triangle_intensities.end(), range.size(), intensity);
+                m_triangle_materials.insert(m_triangle_materials.end(), range.size(), material);
+                m_triangle_textures.insert(m_triangle_textures.end(), range.size(), texture);
+                m_triangle_uvs.insert(m_triangle_uvs.end(), range.size(), default_triangle_uvs);
+                if (intensity > 0)
+                        for (uint32_t i = first; i < triangles.size(); i++)
+                                m_triangle_light_indices.push_back(i);
+        }
+        void insert(std::span<const Plane> range, glm::vec3 color, float intensity, MaterialHandle material = {}, TextureHandle texture = {}) {
+                uint32_t first = planes.size();
+                planes.insert(planes.end(), range.begin(), range.end());
+                m_plane_colors.insert(m_plane_colors.end(), range.size(), color);
+                m_plane_intensities.insert(m_plane_intensities.end(), range.size(), intensity);
+                m_plane_materials.insert(m_plane_materials.end(), range.size(), material);
+                m_plane_textures.insert(m_plane_textures.end(), range.size(), texture);
+                if (intensity > 0)
+                        for (uint32_t i = first; i < planes.size(); i++)
+                                m_plane_light_indices.push_back(i);
         }
         
-        glm::vec3 normal(ShapeType shape_type, uint32_t index, const Ray& ray, float distance) {
-                switch (shape_type) {
-                        case ShapeType::Circle:
-                                return circles[index].normal(ray, distance);
-                        case ShapeType::Triangle:
-                                return glm::dot(ray.direction, m_triangle_normals[index]) > std::numeric_limits<float>::epsilon() ? -m_triangle_normals[index] : m_triangle_normals[index];
-//                                return m_triangle_normals[index];
-                        case ShapeType::Plane:
-                                return planes[index].normal(ray, distance);
-                }
+        // Shading data is stored once per mesh, emissive meshes are only found by BSDF sampling like triangles and planes.
+        // The mesh buffers move into m_resource, or are copied there when the mesh was built from another resource.
+        void insert(TriangleMesh &&mesh, glm::vec3 color, float intensity, MaterialHandle material = {}, TextureHandle texture = {}) {
+                meshes.push_back(std::move(mesh));
+                m_mesh_colors.push_back(color);
+                m_mesh_intensities.push_back(intensity);
+                m_mesh_materials.push_back(material);
+                m_mesh_textures.push_back(texture);
         }
         
+        template<typename F>
+        void for_each_circle_light(F &&f) {
+                for (uint32_t light_index: m_circle_light_indices)
+                        f(light_index, circles[light_index]);
+        }
         
         HitBuffer intersect_all(const Ray &ray) {
                 float closest_intersection_distance = std::numeric_limits<float>::max();
                 size_t closest_shape_index = 0;
-                ShapeType closest_shape_type;
+                ShapeType closest_shape_type = ShapeType::Circle;
+                glm::vec2 closest_barycentrics{};
+                uint32_t closest_primitive = 0;
                 for (int i = 0; auto &shape: circles) {
                         float intersection_dist = shape.intersect(ray);
                         if (intersection_dist > 0.001 && intersection_dist < closest_intersection_distance) {
@@ -136,11 +388,13 @@ public:
                         i++;
                 }
                 for (int i = 0; auto &shape: triangles) {
-                        float intersection_dist = shape.intersect(ray);
+                        glm::vec2 barycentrics;
+                        float intersection_dist = shape.intersect(ray, barycentrics);
                         if (intersection_dist > 0.001 && intersection_dist < closest_intersection_distance) {
                                 closest_intersection_distance = intersection_dist;
                                 closest_shape_index = i;
                                 closest_shape_type = ShapeType::Triangle;
+                                closest_barycentrics = barycentrics;
                         }
                         i++;
                 }
@@ -153,8 +407,21 @@ public:
                         }
                         i++;
                 }
+                for (int i = 0; auto &mesh: meshes) {
+                        uint32_t primitive;
+                        glm::vec2 barycentrics;
+                        float intersection_dist = mesh.intersect(ray, closest_intersection_distance, primitive, barycentrics);
+                        if (intersection_dist < closest_intersection_distance) {
+                                closest_intersection_distance = intersection_dist;
+                                closest_shape_index = i;
+                                closest_shape_type = ShapeType::Mesh;
+                                closest_barycentrics = barycentrics;
+                                closest_primitive = primitive;
+                        }
+                        i++;
+                }
                 
-                return {.index = closest_shape_index, .distance = closest_intersection_distance, .shape_type = closest_shape_type};
+                return {.index = closest_shape_index, .distance = closest_intersection_distance, .shape_type = closest_shape_type, .barycentrics = closest_barycentrics, .primitive = closest_primitive};
         }
 };
 #endif
\ No newline at end of file
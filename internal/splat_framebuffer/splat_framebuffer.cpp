@@ -0,0 +1 @@
+#include "splat_framebuffer.h"
@@ -0,0 +1,37 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <atomic>
+#include <memory>
+
+// Framebuffer that any number of threads add to at once without locks, for light paths which land on arbitrary pixels.
+// Every channel is a relaxed atomic float, so concurrent splats into one pixel sum up in some order and nothing else
+// is synchronised; read it only after the threads splatting into it have been joined.
+template<uint32_t WIDTH, uint32_t HEIGHT>
+class SplatFramebuffer {
+        static_assert(std::atomic<float>::is_always_lock_free);
+public:  // Public Constructors/Destructors/Overloads
+        SplatFramebuffer() : m_channels(std::make_unique<std::atomic<float>[]>(WIDTH * HEIGHT * 3)) {}
+public:  // Public Member Functions
+        void clear() noexcept {
+                for (uint32_t i = 0; i < WIDTH * HEIGHT * 3; i++)
+                        m_channels[i].store(0.0f, std::memory_order_relaxed);
+        }
+
+        // uv are film coordinates in [0, 1) as taken by Camera::get_ray
+        void splat(glm::vec2 uv, glm::vec3 value) noexcept {
+                uint32_t x = glm::min(uint32_t(uv.x * float(WIDTH)), WIDTH - 1);
+                uint32_t y = glm::min(uint32_t(uv.y * float(HEIGHT)), HEIGHT - 1);
+                std::atomic<float> *pixel = &m_channels[(y * WIDTH + x) * 3];
+                for (int c = 0; c < 3; c++)
+                        pixel[c].fetch_add(value[c], std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] glm::vec3 get(uint32_t x, uint32_t y) const noexcept {
+                const std::atomic<float> *pixel = &m_channels[(y * WIDTH + x) * 3];
+                return {pixel[0].load(std::memory_order_relaxed), pixel[1].load(std::memory_order_relaxed), pixel[2].load(std::memory_order_relaxed)};
+        }
+public:  // Public Member Variables
+private: // Private Member Functions
+private: // Private Member Variables
+        std::unique_ptr<std::atomic<float>[]> m_channels;
+};
@@ -0,0 +1,280 @@
+#include "texture.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include "stb_image.h"
+
+static constexpr size_t tile_bytes = sizeof(glm::u8vec4) * texture_tile_size * texture_tile_size;
+static constexpr size_t minimum_resident_tiles = 64; // a lookup pins 8 tiles, keep enough headroom to never evict them
+static constexpr float eviction_slack = 0.9f;        // evict below the cap so the hand does not sweep on every miss
+
+static const std::array<float, 256> srgb_to_linear = [] {
+        std::array<float, 256> table{};
+        for (int i = 0; i < 256; i++)
+                table[i] = powf(float(i) / 255.0f, 2.2f);
+        return table;
+}();
+
+static glm::u8vec4 encode(glm::vec4 linear) {
+        glm::vec4 encoded{powf(linear.x, 1.0f / 2.2f), powf(linear.y, 1.0f / 2.2f), powf(linear.z, 1.0f / 2.2f), linear.w};
+        encoded = glm::clamp(encoded, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return glm::u8vec4(encoded);
+}
+
+// 2x2 box filter in linear space, odd edges repeat their last row/column
+static std::vector<glm::u8vec4> downsample(std::span<const glm::u8vec4> source, uint32_t width, uint32_t height) {
+        auto linear = [](glm::u8vec4 texel) { return glm::vec4{srgb_to_linear[texel.x], srgb_to_linear[texel.y], srgb_to_linear[texel.z], float(texel.w) / 255.0f}; };
+        uint32_t next_width = std::max(width / 2, 1u);
+        uint32_t next_height = std::max(height / 2, 1u);
+        std::vector<glm::u8vec4> result(size_t(next_width) * next_height);
+        for (uint32_t y = 0; y < next_height; y++) {
+                for (uint32_t x = 0; x < next_width; x++) {
+                        uint32_t x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                        uint32_t y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+                        glm::vec4 sum = linear(source[size_t(y0) * width + x0]) + linear(source[size_t(y0) * width + x1]) + linear(source[size_t(y1) * width + x0]) + linear(source[size_t(y1) * width + x1]);
+                        result[size_t(y) * next_width + x] = encode(sum * 0.25f);
+                }
+        }
+        return result;
+}
+
+TextureCache::TextureCache(size_t memory_cap) : m_memory_cap(std::max(memory_cap, minimum_resident_tiles * tile_bytes)) {
+
+}
+
+TextureHandle TextureCache::load(const char *filepath) {
+        int width, height, channels;
+        if (!stbi_info(filepath, &width, &height, &channels)) {
+                std::cerr << "Failed to load texture " << filepath << ": " << stbi_failure_reason() << "\n";
+                return {};
+        }
+        
+        auto texture = std::make_unique<Texture>();
+        texture->filepath = filepath;
+        size_t first_tile = 0;
+        for (uint32_t level_width = width, level_height = height;; level_width = std::max(level_width / 2, 1u), level_height = std::max(level_height / 2, 1u)) {
+                uint32_t tiles_x = (level_width + texture_tile_size - 1) / texture_tile_size;
+                uint32_t tiles_y = (level_height + texture_tile_size - 1) / texture_tile_size;
+                texture->levels.push_back(MipLevel{.width = level_width, .height = level_height, .tiles_x = tiles_x, .tiles_y = tiles_y, .first_tile = first_tile, .tiles = std::vector<std::unique_ptr<Tile>>(tiles_x * tiles_y)});
+                first_tile += size_t(tiles_x) * tiles_y;
+                if (level_width == 1 && level_height == 1)
+                        break;
+        }
+        
+        std::unique_lock lock(m_mutex);
+        m_textures.push_back(std::move(texture));
+        return {.index = uint32_t(m_textures.size() - 1)};
+}
+
+void TextureCache::bilinear_requests(const MipLevel &mip_level, uint32_t level, glm::vec2 uv, float weight, std::span<TexelRequest, 4> requests) noexcept {
+        float x = uv.x * float(mip_level.width) - 0.5f;
+        float y = uv.y * float(mip_level.height) - 0.5f;
+        float x_floor = floorf(x);
+        float y_floor = floorf(y);
+        float fx = x - x_floor;
+        float fy = y - y_floor;
+        
+        // Repeat wrapping, computed in 64 bits so large uv values do not overflow
+        auto wrap = [](float coordinate, uint32_t size) { return uint32_t(((int64_t(coordinate) % int64_t(size)) + size) % size); };
+        uint32_t x0 = wrap(x_floor, mip_level.width), x1 = wrap(x_floor + 1.0f, mip_level.width);
+        uint32_t y0 = wrap(y_floor, mip_level.height), y1 = wrap(y_floor + 1.0f, mip_level.height);
+        
+        requests[0] = {.level = level, .texel = {x0, y0}, .weight = weight * (1.0f - fx) * (1.0f - fy)};
+        requests[1] = {.level = level, .texel = {x1, y0}, .weight = weight * fx * (1.0f - fy)};
+        requests[2] = {.level = level, .texel = {x0, y1}, .weight = weight * (1.0f - fx) * fy};
+        requests[3] = {.level = level, .texel = {x1, y1}, .weight = weight * fx * fy};
+}
+
+uint32_t TextureCache::tile_index(const MipLevel &mip_level, glm::uvec2 texel) noexcept {
+        return (texel.y / texture_tile_size) * mip_level.tiles_x + texel.x / texture_tile_size;
+}
+
+TextureCache::Tile *TextureCache::find_tile(const Texture &texture, TexelRequest request) noexcept {
+        const MipLevel &mip_level = texture.levels[request.level];
+        return mip_level.tiles[tile_index(mip_level, request.texel)].get();
+}
+
+glm::vec3 TextureCache::sample(TextureHandle handle, glm::vec2 uv, float footprint) {
+        Texture *texture_pointer;
+        {
+                std::shared_lock lock(m_mutex); // load() may grow m_textures meanwhile, the textures themselves never move
+                texture_pointer = m_textures[handle.index].get();
+        }
+        Texture &texture = *texture_pointer;
+        const MipLevel &base = texture.levels[0];
+        
+        float lod = log2f(glm::max(footprint * float(std::max(base.width, base.height)), 1e-8f));
+        lod = glm::clamp(lod, 0.0f, float(texture.levels.size() - 1));
+        uint32_t level = uint32_t(lod);
+        uint32_t next_level = std::min(level + 1, uint32_t(texture.levels.size() - 1));
+        float blend = lod - float(level);
+        
+        // Both bilinear footprints are resolved up front so a single lock covers the whole lookup
+        std::array<TexelRequest, 8> requests;
+        bilinear_requests(texture.levels[level], level, uv, 1.0f - blend, std::span(requests).first<4>());
+        bilinear_requests(texture.levels[next_level], next_level, uv, blend, std::span(requests).last<4>());
+        
+        while (true) {
+                {
+                        std::shared_lock lock(m_mutex);
+                        glm::vec3 color{0};
+                        bool resident = true;
+                        for (const TexelRequest &request: requests) {
+                                if (request.weight <= 0.0f)
+                                        continue;
+                                Tile *tile = find_tile(texture, request);
+                                if (tile == nullptr) {
+                                        resident = false;
+                                        break;
+                                }
+                                if (!tile->referenced.load(std::memory_order_relaxed)) // Avoid dirtying the line on every hit
+                                        tile->referenced.store(true, std::memory_order_relaxed);
+                                
+                                glm::u8vec4 texel = tile->texels[(request.texel.y % texture_tile_size) * texture_tile_size + request.texel.x % texture_tile_size];
+                                color += request.weight * glm::vec3{srgb_to_linear[texel.x], srgb_to_linear[texel.y], srgb_to_linear[texel.z]};
+                        }
+                        if (resident)
+                                return color;
+                }
+                
+                load_tiles(texture, requests);
+        }
+}
+
+// Decodes the image and writes every level of its pyramid to an anonymous temporary file, tile after tile in the order
+// of MipLevel::first_tile. Only the level being written and the next one down are held in memory, both as RGBA8.
+void TextureCache::build_tiles(Texture &texture) {
+        int width, height, channels;
+        stbi_uc *pixels = stbi_load(texture.filepath.c_str(), &width, &height, &channels, 4);
+        const MipLevel &base = texture.levels[0];
+        if (pixels == nullptr || uint32_t(width) != base.width || uint32_t(height) != base.height) {
+                std::cerr << "Failed to decode texture " << texture.filepath << ", it changed since it was loaded\n";
+                stbi_image_free(pixels);
+                return;
+        }
+        std::unique_ptr<std::FILE, FileCloser> file(std::tmpfile());
+        if (file == nullptr) {
+                std::cerr << "Failed to create the tile file of texture " << texture.filepath << "\n";
+                stbi_image_free(pixels);
+                return;
+        }
+        
+        std::span<const glm::u8vec4> level_texels(reinterpret_cast<const glm::u8vec4 *>(pixels), size_t(base.width) * base.height);
+        std::vector<glm::u8vec4> downsampled;
+        bool written = true;
+        for (uint32_t level = 0; level < texture.levels.size() && written; level++) {
+                const MipLevel &mip_level = texture.levels[level];
+                std::array<glm::u8vec4, texture_tile_size * texture_tile_size> tile;
+                for (uint32_t tile_y = 0; tile_y < mip_level.tiles_y; tile_y++) {
+                        for (uint32_t tile_x = 0; tile_x < mip_level.tiles_x; tile_x++) {
+                                for (uint32_t y = 0; y < texture_tile_size; y++) {
+                                        for (uint32_t x = 0; x < texture_tile_size; x++) {
+                                                uint32_t level_x = std::min(tile_x * texture_tile_size + x, mip_level.width - 1);
+                                                uint32_t level_y = std::min(tile_y * texture_tile_size + y, mip_level.height - 1);
+                                                tile[y * texture_tile_size + x] = level_texels[size_t(level_y) * mip_level.width + level_x];
+                                        }
+                                }
+                                written &= std::fwrite(tile.data(), tile_bytes, 1, file.get()) == 1;
+                        }
+                }
+                
+                if (level + 1 < texture.levels.size()) {
+                        downsampled = downsample(level_texels, mip_level.width, mip_level.height);
+                        level_texels = downsampled;
+                }
+                if (level == 0) {
+                        stbi_image_free(pixels);
+                        pixels = nullptr;
+                }
+        }
+        stbi_image_free(pixels);
+        
+        if (!written || std::fflush(file.get()) != 0) {
+                std::cerr << "Failed to write the tile file of texture " << texture.filepath << "\n";
+                return;
+        }
+        texture.tiles = std::move(file);
+}
+
+std::unique_ptr<TextureCache::Tile> TextureCache::read_tile(Texture &texture, uint32_t level, uint32_t tile_index) {
+        auto tile = std::make_unique<Tile>();
+        bool read = false;
+        if (texture.tiles != nullptr) {
+                std::lock_guard lock(texture.file_mutex);
+                long offset = long((texture.levels[level].first_tile + tile_index) * tile_bytes);
+                read = std::fseek(texture.tiles.get(), offset, SEEK_SET) == 0 && std::fread(tile->texels.data(), tile_bytes, 1, texture.tiles.get()) == 1;
+        }
+        if (!read)
+                tile->texels.fill(glm::u8vec4{255, 0, 255, 255}); // Magenta if the texture could not be decoded
+        return tile;
+}
+
+// Reads the requested tiles that are not resident without holding the cache lock, so other threads keep sampling
+// resident tiles meanwhile, then installs them under the exclusive lock. Every requested tile is marked and pinned
+// while the clock hand evicts, so the lookup that missed finds all of them resident when it retries.
+void TextureCache::load_tiles(Texture &texture, std::span<const TexelRequest> requests) {
+        std::call_once(texture.built, build_tiles, std::ref(texture));
+        
+        struct PendingTile {
+                uint32_t level;
+                uint32_t index;
+                std::unique_ptr<Tile> tile;
+        };
+        std::vector<PendingTile> pending;
+        {
+                std::shared_lock lock(m_mutex);
+                for (const TexelRequest &request: requests) {
+                        if (request.weight <= 0.0f || find_tile(texture, request) != nullptr)
+                                continue;
+                        uint32_t index = tile_index(texture.levels[request.level], request.texel);
+                        if (std::none_of(pending.begin(), pending.end(), [&](const PendingTile &tile) { return tile.level == request.level && tile.index == index; }))
+                                pending.push_back(PendingTile{.level = request.level, .index = index, .tile = nullptr});
+                }
+        }
+        for (PendingTile &tile: pending)
+                tile.tile = read_tile(texture, tile.level, tile.index);
+        
+        std::unique_lock lock(m_mutex);
+        for (PendingTile &tile: pending) {
+                std::unique_ptr<Tile> &slot = texture.levels[tile.level].tiles[tile.index];
+                if (slot != nullptr)
+                        continue; // Another thread installed it first
+                slot = std::move(tile.tile);
+                m_clock_ring.push_back(&slot);
+                m_resident_bytes += tile_bytes;
+                m_misses++;
+        }
+        std::vector<const Tile *> pinned;
+        for (const TexelRequest &request: requests) {
+                if (request.weight <= 0.0f)
+                        continue;
+                if (Tile *tile = find_tile(texture, request)) {
+                        tile->referenced.store(true, std::memory_order_relaxed);
+                        pinned.push_back(tile);
+                }
+        }
+        if (m_resident_bytes > m_memory_cap)
+                evict_to(size_t(float(m_memory_cap) * eviction_slack), pinned);
+}
+
+// Must hold the exclusive lock. The hand unmarks marked tiles and evicts unmarked ones until target_bytes remain, so
+// it visits every tile at most twice however many it has to pass. Pinned tiles are passed over without being unmarked.
+void TextureCache::evict_to(size_t target_bytes, std::span<const Tile *const> pinned) {
+        for (size_t visits = 2 * m_clock_ring.size(); m_resident_bytes > target_bytes && visits > 0; visits--) {
+                if (m_clock_hand >= m_clock_ring.size())
+                        m_clock_hand = 0;
+                std::unique_ptr<Tile> &slot = *m_clock_ring[m_clock_hand];
+                if (std::find(pinned.begin(), pinned.end(), slot.get()) != pinned.end() || slot->referenced.exchange(false, std::memory_order_relaxed)) {
+                        m_clock_hand++;
+                        continue;
+                }
+                
+                slot.reset();
+                m_resident_bytes -= tile_bytes;
+                m_evictions++;
+                m_clock_ring[m_clock_hand] = m_clock_ring.back(); // The hand looks at the moved slot next
+                m_clock_ring.pop_back();
+        }
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+static constexpr uint32_t texture_tile_size = 16; // 16x16 RGBA8 texels, 1KiB or 16 cache lines per tile
+static constexpr size_t default_texture_memory_cap = size_t(256) << 20;
+
+struct TextureHandle {
+        uint32_t index = std::numeric_limits<uint32_t>::max(); // default handle means untextured
+        [[nodiscard]] bool valid() const noexcept { return index != std::numeric_limits<uint32_t>::max(); }
+};
+
+// Image textures stored as mip pyramids cut into square tiles, so the texels a filtered lookup touches share a few cache
+// lines instead of striding across rows. Only header information is read by load(). The first miss on a texture decodes
+// it through stb_image once and writes its whole tiled pyramid to an anonymous temporary file, later misses read single
+// tiles back from it. Once resident tiles exceed the memory cap they are evicted by the clock algorithm, which
+// approximates least recently used: every lookup marks the tiles it reads, and the clock hand sweeping over the resident
+// tiles unmarks a marked tile instead of evicting it.
+class TextureCache {
+public:  // Public Constructors/Destructors/Overloads
+        explicit TextureCache(size_t memory_cap = default_texture_memory_cap);
+        TextureCache(const TextureCache &) = delete;
+        TextureCache &operator=(const TextureCache &) = delete;
+public:  // Public Member Functions
+        [[nodiscard]] TextureHandle load(const char *filepath);
+        
+        // Trilinear lookup with repeat wrapping, footprint is the width of the ray footprint in uv units.
+        // Returns linear RGB, texels are stored sRGB encoded.
+        [[nodiscard]] glm::vec3 sample(TextureHandle texture, glm::vec2 uv, float footprint);
+        
+        [[nodiscard]] size_t resident_bytes() const noexcept { return m_resident_bytes.load(std::memory_order_relaxed); }
+        [[nodiscard]] size_t misses() const noexcept { return m_misses.load(std::memory_order_relaxed); }
+        [[nodiscard]] size_t evictions() const noexcept { return m_evictions.load(std::memory_order_relaxed); }
+public:  // Public Member Variables
+private: // Private Member Functions
+        struct Tile {
+                std::array<glm::u8vec4, texture_tile_size * texture_tile_size> texels;
+                std::atomic<bool> referenced{true}; // set by every lookup, cleared as the clock hand passes
+        };
+        struct MipLevel {
+                uint32_t width;
+                uint32_t height;
+                uint32_t tiles_x;
+                uint32_t tiles_y;
+                size_t first_tile; // position of the level's first tile in the tile file
+                std::vector<std::unique_ptr<Tile>> tiles; // nullptr while not resident
+        };
+        struct FileCloser {
+                void operator()(std::FILE *file) const noexcept { std::fclose(file); }
+        };
+        struct Texture {
+                std::string filepath;
+                std::vector<MipLevel> levels;
+                
+                std::once_flag built;                         // the tile file is written by the first miss
+                std::unique_ptr<std::FILE, FileCloser> tiles; // every level's tiles in order, nullptr if decoding failed
+                std::mutex file_mutex;                        // held from seeking to the end of reading a tile
+        };
+        struct TexelRequest {
+                uint32_t level;
+                glm::uvec2 texel;
+                float weight;
+        };
+        
+        static void bilinear_requests(const MipLevel &mip_level, uint32_t level, glm::vec2 uv, float weight, std::span<TexelRequest, 4> requests) noexcept;
+        [[nodiscard]] static uint32_t tile_index(const MipLevel &mip_level, glm::uvec2 texel) noexcept;
+        [[nodiscard]] static Tile *find_tile(const Texture &texture, TexelRequest request) noexcept;
+        static void build_tiles(Texture &texture);
+        [[nodiscard]] static std::unique_ptr<Tile> read_tile(Texture &texture, uint32_t level, uint32_t tile_index);
+        void load_tiles(Texture &texture, std::span<const TexelRequest> requests);
+        void evict_to(size_t target_bytes, std::span<const Tile *const> pinned);
+private: // Private Member Variables
+        std::vector<std::unique_ptr<Texture>> m_textures; // stable addresses, the vector itself is guarded by m_mutex
+        
+        mutable std::shared_mutex m_mutex; // shared for lookups, exclusive while tiles are installed or evicted
+        std::vector<std::unique_ptr<Tile> *> m_clock_ring; // slot of every resident tile, in the order the hand visits
+        size_t m_clock_hand = 0;
+        size_t m_memory_cap;
+        
+        // Written under the exclusive lock, atomic so the statistics can be read without it
+        std::atomic<size_t> m_resident_bytes{0};
+        std::atomic<size_t> m_misses{0};
+        std::atomic<size_t> m_evictions{0};
+};
@@ -0,0 +1,92 @@
+#include "scene.h"
+
+#ifdef SOA
+#include <algorithm>
+#include <vector>
+
+// Compares the runtime built ShapeSoA against a FrozenShapeSoA and a BakedShapeSoA of the same scene, single threaded
+// so only the intersection/light loops differ between the runs. Every timing is the median of several repetitions
+// after a warm-up pass.
+//      bake_benchmark [repetitions]
+static constexpr uint32_t benchmark_width = 128;
+static constexpr uint32_t benchmark_height = 128;
+static constexpr int benchmark_samples = 64;
+static constexpr int default_repetitions = 9;
+
+static constexpr std::array<BakedPrimitive, 9> main_scene{{
+        {Circle(glm::vec3{0.0, 1.5, -1.0}, 1), {200, 100, 100}, 10},
+        {Plane(glm::vec3{0.0, 1.0, 0.0}, 0), {200, 200, 200}, 0},
+        {Triangle(glm::vec3{5.0, 0.0, 0.0}, glm::vec3{6.0, 1.0, 0.0}, glm::vec3{4.0, 0.0, 1.0}), {200, 100, 100}, 0},
+        {Triangle(glm::vec3{2.0, 0.0, 0.0}, glm::vec3{0.0, 1.0, 0.0}, glm::vec3{0.0, 0.0, 1.0}), {100, 200, 100}, 0},
+        {Triangle(glm::vec3{-2.0, 0.0, 0.0}, glm::vec3{-1.0, 1.0, 0.0}, glm::vec3{-1.0, 0.0, 1.0}), {100, 100, 200}, 0},
+        {Triangle(glm::vec3{0.0, 0.0, 0.0}, glm::vec3{0.0, 1.0, 0.0}, glm::vec3{0.0, 0.0, 1.0}), {100, 100, 200}, 0},
+        {Circle(glm::vec3{0.0, 0.0, -1.0}, 0.5), {255, 255, 255}, 10},
+        {Circle(glm::vec3{-1.0, 0.0, -1.0}, 0.5), {100, 200, 100}, 0, {.type = MaterialType::Dielectric}},
+        {Circle(glm::vec3{1.0, 0.0, -1.0}, 0.5), {100, 100, 200}, 0, {.type = MaterialType::Metal}},
+}};
+
+// Median wall time of run in milliseconds over repetitions, after one untimed warm-up run
+template<typename F>
+static int64_t median_ms(int repetitions, F &&run) {
+        run();
+        std::vector<int64_t> times;
+        for (int i = 0; i < repetitions; i++) {
+                BS::timer timer;
+                run();
+                timer.stop();
+                times.push_back(timer.ms());
+        }
+        std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+        return times[times.size() / 2];
+}
+
+template<typename SCENE>
+void benchmark(const char *name, SCENE &scene, int repetitions) {
+        size_t hits = 0;
+        int64_t intersect_ms = median_ms(repetitions, [&] {
+                hits = 0;
+                for (uint32_t s = 0; s < benchmark_samples; s++)
+                        for (uint32_t y = 0; y < benchmark_height; y++)
+                                for (uint32_t x = 0; x < benchmark_width; x++)
+                                        hits += scene.intersectSoA(scene.m_camera.get_ray(glm::vec2{float(x), float(y)} / glm::vec2{benchmark_width, benchmark_height})).is_hit();
+        });
+        
+        glm::vec3 total{0};
+        int64_t sample_ms = median_ms(repetitions, [&] {
+                total = glm::vec3{0};
+                for (uint32_t y = 0; y < benchmark_height; y++) {
+                        for (uint32_t x = 0; x < benchmark_width; x++) {
+                                uint32_t seed = x + y * benchmark_width;
+                                for (int s = 0; s < benchmark_samples; s++)
+                                        total += scene.sample(seed, scene.m_camera.get_ray(glm::vec2{x + random_pcg(seed), y + random_pcg(seed)} / glm::vec2{benchmark_width, benchmark_height}), recurse_depth, 0.0f, scene.m_camera.pixel_cone(benchmark_height));
+                        }
+                }
+        });
+        
+        float ray_count = float(benchmark_width * benchmark_height * benchmark_samples);
+        std::cout << name << ": primary intersections " << intersect_ms << "ms (" << ray_count / float(std::max<int64_t>(intersect_ms, 1)) / 1000.0f << " Mrays/s), "
+                  << "paths " << sample_ms << "ms (" << ray_count / float(std::max<int64_t>(sample_ms, 1)) / 1000.0f << " Mpaths/s), "
+                  << "checksum " << hits << " / " << (total.x + total.y + total.z) / ray_count << "\n";
+}
+
+int main(int argc, char *argv[]) {
+        int repetitions = argc > 1 ? std::max(std::stoi(argv[1]), 1) : default_repetitions;
+        std::cout << "median of " << repetitions << " repetitions\n";
+        Scene<benchmark_width, benchmark_height> dynamic_scene({-2, 2, 1}, glm::vec3{0, 0, -1}, {0, 1, 0}, 90);
+        for (const BakedPrimitive &primitive: main_scene)
+                std::visit([&](auto &&shape) { dynamic_scene.m_shape_soa.insert(shape, primitive.color, primitive.intensity, primitive.material); }, primitive.shape);
+        Scene<benchmark_width, benchmark_height, FrozenShapeSoA> frozen_scene({-2, 2, 1}, glm::vec3{0, 0, -1}, {0, 1, 0}, 90);
+        frozen_scene.m_shape_soa = FrozenShapeSoA(dynamic_scene.m_shape_soa);
+        Scene<benchmark_width, benchmark_height, BakedShapeSoA<main_scene>> baked_scene({-2, 2, 1}, glm::vec3{0, 0, -1}, {0, 1, 0}, 90);
+        
+        benchmark("dynamic", dynamic_scene, repetitions);
+        benchmark("frozen ", frozen_scene, repetitions);
+        benchmark("baked  ", baked_scene, repetitions);
+        return 0;
+}
+#else
+int main(int argc, char *argv[]) {
+        std::cout << "BakedShapeSoA is only available in SOA builds\n";
+        return 0;
+}
+#endif
@@ -0,0 +1,71 @@
+#include "scene.h"
+
+#ifdef SOA
+#include <memory_resource>
+#include <string>
+#include <sys/resource.h>
+
+// Times building a large ShapeSoA one insert at a time against a reserved bulk build into a monotonic arena, and the
+// cost of freezing the result. Page faults are the minor faults of this process over each step.
+//      build_benchmark [primitives]
+static constexpr size_t default_primitive_count = 1000000;
+
+static long page_faults() {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_minflt;
+}
+
+static void report(const char *name, BS::timer &timer, long faults_before) {
+        timer.stop();
+        std::cout << name << ": " << timer.ms() << "ms, " << page_faults() - faults_before << " page faults\n";
+}
+
+int main(int argc, char *argv[]) {
+        size_t count = argc > 1 ? std::stoul(argv[1]) : default_primitive_count;
+
+        uint32_t seed = 1;
+        std::vector<Circle> source_circles;
+        std::vector<Triangle> source_triangles;
+        source_circles.reserve(count);
+        source_triangles.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+                glm::vec3 center = random_vec3_pcg(seed, -100, 100);
+                source_circles.emplace_back(center, random_pcg(seed, 0.1f, 1.0f));
+                source_triangles.emplace_back(center, center + random_vec3_pcg(seed, -1, 1), center + random_vec3_pcg(seed, -1, 1));
+        }
+        std::cout << count << " circles and " << count << " triangles\n";
+
+        {
+                long faults = page_faults();
+                BS::timer timer;
+                ShapeSoA shapes;
+                for (const Circle &circle: source_circles)
+                        shapes.insert(circle, {200, 200, 200}, 0);
+                for (const Triangle &triangle: source_triangles)
+                        shapes.insert(triangle, {200, 200, 200}, 0);
+                report("insert one by one   ", timer, faults);
+        }
+
+        long faults = page_faults();
+        BS::timer timer;
+        std::pmr::monotonic_buffer_resource arena;
+        ShapeSoA shapes(&arena);
+        shapes.reserve({.circles = count, .triangles = count});
+        shapes.insert(std::span<const Circle>(source_circles), {200, 200, 200}, 0);
+        shapes.insert(std::span<const Triangle>(source_triangles), {200, 200, 200}, 0);
+        report("reserved bulk insert", timer, faults);
+
+        faults = page_faults();
+        BS::timer freeze_timer;
+        FrozenShapeSoA frozen(shapes);
+        report("freeze              ", freeze_timer, faults);
+        std::cout << "frozen block " << frozen.block_bytes() / (1 << 20) << "MiB\n";
+        return 0;
+}
+#else
+int main(int argc, char *argv[]) {
+        std::cout << "The build benchmark is only available in SOA builds\n";
+        return 0;
+}
+#endif
@@ -0,0 +1,346 @@
+#include "scene.h"
+
+#ifdef SOA
+#include <memory>
+#include <string>
+#include <fstream>
+#include <map>
+#include <cstdio>
+
+// Renders the canonical scenes through Scene::render at every doubling of the sample count and records the error against
+// a stored high spp reference, so changes to Scene::sample or to the render loop can be judged by error versus wall time.
+// At baseline_spp the error and the render time are also checked against assets/reference/baseline.csv.
+//      convergence_benchmark [--sorted] [max_spp]  compare against assets/reference/<scene>.hdr, curves go to output/
+//      convergence_benchmark --reference [spp]     re-render the references, then record a new baseline
+//      convergence_benchmark --baseline            record a new baseline, timings only compare on the same machine
+// --sorted renders with Scene::m_sort_secondary_rays, against the same baseline as the default render loop.
+static constexpr uint32_t convergence_width = 96;
+static constexpr uint32_t convergence_height = 96;
+static constexpr uint32_t default_max_spp = 256;
+static constexpr uint32_t default_reference_spp = 4096;
+static constexpr uint32_t reference_seed_offset = 1u << 31; // far from every measured seed, so references are independent
+static constexpr double required_convergence_rate = -0.5;   // Monte Carlo error falls as 1/spp, a slope of -1
+static constexpr uint32_t first_fitted_spp = 4;             // below it a few rare paths decide the error, not the spp
+static constexpr size_t minimum_fitted_checkpoints = 3;
+static constexpr uint32_t baseline_spp = 64;
+static constexpr int baseline_repetitions = 5;       // the baseline time is the median of this many renders
+static constexpr double baseline_error_tolerance = 1.1; // the error only moves with float summation order between runs
+static constexpr double baseline_time_tolerance = 1.5;  // wall time is noisy, this catches slowdowns, not a few percent
+static constexpr const char *baseline_path = "assets/reference/baseline.csv";
+
+typedef Scene<convergence_width, convergence_height> ConvergenceScene;
+
+struct CanonicalScene {
+        const char *name;
+        std::unique_ptr<ConvergenceScene> (*build)();
+};
+
+// The scene rendered by src/main.cpp with glass and brushed metal in place of its two lower diffuse spheres, showing
+// the specular and rough lobes of the material system next to each other
+static std::unique_ptr<ConvergenceScene> build_materials_scene() {
+        auto scene = std::make_unique<ConvergenceScene>(glm::vec3{-2, 2, 1}, glm::vec3{0, 0, -1}, glm::vec3{0, 1, 0}, 90);
+        MaterialHandle glass = scene->m_material_soa.insert(Dielectric(1.5f));
+        MaterialHandle brushed_metal = scene->m_material_soa.insert(Metal(0.2f));
+        
+        scene->m_shape_soa.insert(Circle(glm::vec3{0.0, 1.5, -1.0}, 1), {200, 100, 100}, 10);
+        scene->m_shape_soa.insert(Plane(glm::vec3{0.0, 1.0, 0.0}, 0), {200, 200, 200}, 0);
+        scene->m_shape_soa.insert(Triangle(glm::vec3{5.0, 0.0, 0.0}, glm::vec3{6.0, 1.0, 0.0}, glm::vec3{4.0, 0.0, 1.0}), {200, 100, 100}, 0);
+        scene->m_shape_soa.insert(Triangle(glm::vec3{2.0, 0.0, 0.0}, glm::vec3{0.0, 1.0, 0.0}, glm::vec3{0.0, 0.0, 1.0}), {100, 200, 100}, 0);
+        scene->m_shape_soa.insert(Triangle(glm::vec3{-2.0, 0.0, 0.0}, glm::vec3{-1.0, 1.0, 0.0}, glm::vec3{-1.0, 0.0, 1.0}), {100, 100, 200}, 0);
+        scene->m_shape_soa.insert(Triangle(glm::vec3{0.0, 0.0, 0.0}, glm::vec3{0.0, 1.0, 0.0}, glm::vec3{0.0, 0.0, 1.0}), {100, 100, 200}, 0);
+        scene->m_shape_soa.insert(Circle(glm::vec3{0.0, 0.0, -1.0}, 0.5), {255, 255, 255}, 10);
+        scene->m_shape_soa.insert(Circle(glm::vec3{-1.0, 0.0, -1.0}, 0.5), {100, 200, 100}, 0, glass);
+        scene->m_shape_soa.insert(Circle(glm::vec3{1.0, 0.0, -1.0}, 0.5), {100, 100, 200}, 0, brushed_metal);
+        return scene;
+}
+
+// A tiny, very bright light that BSDF sampling almost never finds, everything rests on next event estimation
+static std::unique_ptr<ConvergenceScene> build_small_light_scene() {
+        auto scene = std::make_unique<ConvergenceScene>(glm::vec3{0, 1.5, 3}, glm::vec3{0, 0.5, 0}, glm::vec3{0, 1, 0}, 60);
+        scene->m_shape_soa.insert(Circle(glm::vec3{0.5, 3.0, 0.5}, 0.05), {255, 240, 220}, 2000);
+        scene->m_shape_soa.insert(Plane(glm::vec3{0.0, 1.0, 0.0}, 0), {180, 180, 180}, 0);
+        scene->m_shape_soa.insert(Circle(glm::vec3{-0.8, 0.5, 0.0}, 0.5), {200, 80, 80}, 0);
+        scene->m_shape_soa.insert(Circle(glm::vec3{0.8, 0.5, 0.0}, 0.5), {80, 80, 200}, 0);
+        scene->m_shape_soa.insert(Triangle(glm::vec3{-2.0, 0.0, -1.5}, glm::vec3{2.0, 0.0, -1.5}, glm::vec3{0.0, 2.5, -1.5}), {80, 200, 80}, 0);
+        return scene;
+}
+
+// Mirror-like and rough glossy lobes lit by a large light, where neither BSDF nor light sampling alone is enough
+static std::unique_ptr<ConvergenceScene> build_glossy_scene() {
+        auto scene = std::make_unique<ConvergenceScene>(glm::vec3{0, 1.0, 3}, glm::vec3{0, 0.4, 0}, glm::vec3{0, 1, 0}, 60);
+        MaterialHandle polished_floor = scene->m_material_soa.insert(Glossy(0.1f));
+        MaterialHandle smooth_metal = scene->m_material_soa.insert(Metal(0.05f));
+        MaterialHandle rough_metal = scene->m_material_soa.insert(Metal(0.4f));
+        
+        scene->m_shape_soa.insert(Circle(glm::vec3{0.0, 3.5, -2.0}, 1.5), {255, 255, 255}, 4);
+        scene->m_shape_soa.insert(Plane(glm::vec3{0.0, 1.0, 0.0}, 0), {120, 90, 60}, 0, polished_floor);
+        scene->m_shape_soa.insert(Circle(glm::vec3{-0.7, 0.5, 0.0}, 0.5), {230, 200, 150}, 0, smooth_metal);
+        scene->m_shape_soa.insert(Circle(glm::vec3{0.7, 0.5, 0.0}, 0.5), {200, 200, 210}, 0, rough_metal);
+        return scene;
+}
+
+// Lit only by a procedural sky with a small sun, which uniform or BSDF sampling of the environment rarely hits
+static std::unique_ptr<ConvergenceScene> build_environment_scene() {
+        auto scene = std::make_unique<ConvergenceScene>(glm::vec3{0, 1.0, 3}, glm::vec3{0, 0.4, 0}, glm::vec3{0, 1, 0}, 60);
+        MaterialHandle rough_metal = scene->m_material_soa.insert(Glossy(0.3f));
+        
+        constexpr uint32_t sky_width = 256, sky_height = 128;
+        const glm::vec3 sun_direction = glm::normalize(glm::vec3{0.6, 0.5, 0.4});
+        std::vector<glm::vec3> sky(sky_width * sky_height);
+        for (uint32_t y = 0; y < sky_height; y++) {
+                for (uint32_t x = 0; x < sky_width; x++) {
+                        float phi = ((float(x) + 0.5f) / float(sky_width) - 0.5f) * 2.0f * std::numbers::pi_v<float>;
+                        float theta = (float(y) + 0.5f) / float(sky_height) * std::numbers::pi_v<float>;
+                        glm::vec3 direction{sinf(theta) * sinf(phi), cosf(theta), -sinf(theta) * cosf(phi)};
+                        glm::vec3 color = direction.y > 0.0f ? glm::mix(glm::vec3{0.8, 0.9, 1.0}, glm::vec3{0.2, 0.4, 0.9}, direction.y) : glm::vec3{0.1, 0.08, 0.06};
+                        if (glm::dot(direction, sun_direction) > 0.999f)
+                                color = glm::vec3{2000.0, 1800.0, 1500.0};
+                        sky[y * sky_width + x] = color;
+                }
+        }
+        scene->m_environment.set(std::move(sky), sky_width, sky_height);
+        
+        scene->m_shape_soa.insert(Plane(glm::vec3{0.0, 1.0, 0.0}, 0), {180, 180, 180}, 0);
+        scene->m_shape_soa.insert(Circle(glm::vec3{-0.7, 0.5, 0.0}, 0.5), {200, 80, 80}, 0);
+        scene->m_shape_soa.insert(Circle(glm::vec3{0.7, 0.5, 0.0}, 0.5), {200, 200, 210}, 0, rough_metal);
+        return scene;
+}
+
+// A small, bright light focused onto the floor by a glass sphere. Camera paths find the caustic only when a diffuse bounce
+// happens to refract into the light, so the scene also traces light paths which splat it directly. The camera still sees
+// the caustic through the glass, which only camera paths reach, so their samples are clamped.
+static std::unique_ptr<ConvergenceScene> build_caustic_scene() {
+        auto scene = std::make_unique<ConvergenceScene>(glm::vec3{0, 1.5, 3}, glm::vec3{0, 0.3, 0}, glm::vec3{0, 1, 0}, 50);
+        MaterialHandle glass = scene->m_material_soa.insert(Dielectric(1.5f));
+        
+        scene->m_shape_soa.insert(Circle(glm::vec3{0.4, 3.0, -0.3}, 0.1), {255, 240, 220}, 400);
+        scene->m_shape_soa.insert(Plane(glm::vec3{0.0, 1.0, 0.0}, 0), {180, 180, 180}, 0);
+        scene->m_shape_soa.insert(Triangle(glm::vec3{-3.0, 0.0, -1.5}, glm::vec3{3.0, 0.0, -1.5}, glm::vec3{0.0, 3.0, -1.5}), {80, 160, 80}, 0);
+        scene->m_shape_soa.insert(Circle(glm::vec3{0.0, 0.6, 0.0}, 0.5), {255, 255, 255}, 0, glass);
+        scene->m_trace_light_paths = true;
+        scene->m_max_sample_luminance = 20.0f; // darkens the image by about 1%, all of it in the caustic seen through the glass
+        return scene;
+}
+
+static const CanonicalScene canonical_scenes[] = {
+        {"materials", build_materials_scene},
+        {"small_light", build_small_light_scene},
+        {"glossy", build_glossy_scene},
+        {"environment", build_environment_scene},
+        {"caustic", build_caustic_scene},
+};
+
+struct ImageError {
+        double rmse;
+        double relative_mse; // mean of (x - ref)^2 / (ref^2 + 0.01), which keeps dark and bright regions comparable
+        bool finite;
+};
+
+struct Baseline {
+        double time_ms;      // median render time at baseline_spp
+        double relative_mse; // at baseline_spp
+};
+
+static ImageError compare(const std::vector<glm::vec3> &image, const float *reference) {
+        double squared = 0.0;
+        double relative = 0.0;
+        bool finite = true;
+        for (size_t i = 0; i < image.size() * 3; i++) {
+                double value = double(image[i / 3][int(i % 3)]);
+                finite &= std::isfinite(value);
+                double difference = value - double(reference[i]);
+                squared += difference * difference;
+                relative += difference * difference / (double(reference[i]) * double(reference[i]) + 0.01);
+        }
+        return {.rmse = std::sqrt(squared / double(image.size() * 3)), .relative_mse = relative / double(image.size() * 3), .finite = finite};
+}
+
+// Least squares slope of log relative MSE against log spp over the checkpoints from first_fitted_spp on, so one noisy
+// pass neither fails nor passes a scene on its own the way comparing the first and last checkpoint would
+static double convergence_rate(const std::vector<uint32_t> &spp, const std::vector<ImageError> &errors) {
+        double n = 0.0, sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0;
+        for (size_t i = 0; i < errors.size(); i++) {
+                if (spp[i] < first_fitted_spp)
+                        continue;
+                double x = std::log(double(spp[i]));
+                double y = std::log(std::max(errors[i].relative_mse, 1e-30));
+                sum_x += x;
+                sum_y += y;
+                sum_xx += x * x;
+                sum_xy += x * y;
+                n += 1.0;
+        }
+        return (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+}
+
+static std::string reference_path(const CanonicalScene &canonical) {
+        return std::string("assets/reference/") + canonical.name + ".hdr";
+}
+
+// Renders every pixel of the scene from scratch with spp samples through Scene::render, returns the wall time
+static double renderTimed(ConvergenceScene &scene, uint32_t spp) {
+        BS::timer timer;
+        scene.render(int(spp));
+        timer.stop();
+        return double(timer.ms());
+}
+
+static double medianRenderTime(ConvergenceScene &scene, uint32_t spp) {
+        std::vector<double> times;
+        for (int i = 0; i < baseline_repetitions; i++)
+                times.push_back(renderTimed(scene, spp));
+        std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+        return times[times.size() / 2];
+}
+
+static float *loadReference(const CanonicalScene &canonical) {
+        int width, height, channels;
+        std::string path = reference_path(canonical);
+        float *reference = stbi_loadf(path.c_str(), &width, &height, &channels, 3);
+        if (reference == nullptr || width != int(convergence_width) || height != int(convergence_height)) {
+                std::cout << canonical.name << ": missing or mismatched reference " << path << ", run with --reference\n";
+                stbi_image_free(reference);
+                return nullptr;
+        }
+        return reference;
+}
+
+static std::map<std::string, Baseline> loadBaselines() {
+        std::map<std::string, Baseline> baselines;
+        std::ifstream csv(baseline_path);
+        std::string line;
+        std::getline(csv, line); // header
+        while (std::getline(csv, line)) {
+                char name[64];
+                uint32_t spp;
+                Baseline baseline;
+                if (std::sscanf(line.c_str(), "%63[^,],%u,%lf,%lf", name, &spp, &baseline.time_ms, &baseline.relative_mse) == 4 && spp == baseline_spp)
+                        baselines[name] = baseline;
+        }
+        return baselines;
+}
+
+static bool renderReference(const CanonicalScene &canonical, uint32_t spp) {
+        auto scene = canonical.build();
+        scene->m_seed_offset = reference_seed_offset;
+        double time_ms = renderTimed(*scene, spp);
+        
+        // Stored top row first like Image::writeToFile, stb_image flips it back to bottom row first on load
+        std::string path = reference_path(canonical);
+        stbi_flip_vertically_on_write(true);
+        bool written = stbi_write_hdr(path.c_str(), convergence_width, convergence_height, 3, &scene->m_image.data().front().x) != 0;
+        std::cout << canonical.name << ": " << spp << "spp reference in " << time_ms << "ms -> " << path << (written ? "\n" : " (write failed)\n");
+        return written;
+}
+
+// Measures the error and median render time at baseline_spp against the stored reference
+static bool recordBaseline(const CanonicalScene &canonical, std::ofstream &csv) {
+        float *reference = loadReference(canonical);
+        if (reference == nullptr)
+                return false;
+        auto scene = canonical.build();
+        double time_ms = medianRenderTime(*scene, baseline_spp);
+        ImageError error = compare(scene->m_image.data(), reference);
+        stbi_image_free(reference);
+        
+        csv << canonical.name << "," << baseline_spp << "," << time_ms << "," << error.relative_mse << "\n";
+        std::cout << canonical.name << ": baseline " << baseline_spp << "spp " << time_ms << "ms relMSE " << error.relative_mse << "\n";
+        return error.finite;
+}
+
+// Returns false when the reference or baseline is missing, the render produces non finite values, the error does not
+// drop at required_convergence_rate or faster, or at baseline_spp the error or the median render time exceeds the
+// baseline by its tolerance. Runs too short for minimum_fitted_checkpoints skip the rate, runs below baseline_spp skip
+// the baseline.
+static bool measureConvergence(const CanonicalScene &canonical, const std::map<std::string, Baseline> &baselines, uint32_t max_spp, bool sorted) {
+        float *reference = loadReference(canonical);
+        if (reference == nullptr)
+                return false;
+        
+        auto scene = canonical.build();
+        scene->m_sort_secondary_rays = sorted;
+        std::ofstream csv(std::string("output/convergence_") + canonical.name + ".csv");
+        csv << "spp,time_ms,rmse,relative_mse\n";
+        
+        std::vector<uint32_t> checkpoints;
+        std::vector<ImageError> errors;
+        for (uint32_t spp = 1; spp <= max_spp; spp *= 2) {
+                double time_ms = renderTimed(*scene, spp);
+                ImageError error = compare(scene->m_image.data(), reference);
+                checkpoints.push_back(spp);
+                errors.push_back(error);
+                csv << spp << "," << time_ms << "," << error.rmse << "," << error.relative_mse << "\n";
+                std::cout << canonical.name << ": " << spp << "spp " << time_ms << "ms rmse " << error.rmse << " relMSE " << error.relative_mse << "\n";
+        }
+        
+        bool finite = std::all_of(errors.begin(), errors.end(), [](const ImageError &error) { return error.finite; });
+        bool converging = true;
+        if (std::count_if(checkpoints.begin(), checkpoints.end(), [](uint32_t spp) { return spp >= first_fitted_spp; }) >= std::ptrdiff_t(minimum_fitted_checkpoints)) {
+                double rate = convergence_rate(checkpoints, errors);
+                converging = rate <= required_convergence_rate;
+                std::cout << canonical.name << ": relMSE falls as spp^" << rate << "\n";
+        }
+        
+        bool within_baseline = true;
+        auto baseline = baselines.find(canonical.name);
+        if (baseline == baselines.end()) {
+                std::cout << canonical.name << ": FAILED, no baseline in " << baseline_path << ", run with --baseline\n";
+                within_baseline = false;
+        } else if (max_spp >= baseline_spp) {
+                double time_ms = medianRenderTime(*scene, baseline_spp);
+                double relative_mse = compare(scene->m_image.data(), reference).relative_mse;
+                std::cout << canonical.name << ": " << baseline_spp << "spp in " << time_ms << "ms relMSE " << relative_mse << ", baseline " << baseline->second.time_ms << "ms relMSE " << baseline->second.relative_mse << "\n";
+                if (relative_mse > baseline->second.relative_mse * baseline_error_tolerance) {
+                        std::cout << canonical.name << ": FAILED, error at " << baseline_spp << "spp exceeds the baseline\n";
+                        within_baseline = false;
+                }
+                if (time_ms > baseline->second.time_ms * baseline_time_tolerance) {
+                        std::cout << canonical.name << ": FAILED, render time at " << baseline_spp << "spp exceeds the baseline\n";
+                        within_baseline = false;
+                }
+        }
+        stbi_image_free(reference);
+        
+        if (!finite)
+                std::cout << canonical.name << ": FAILED, render contains NaN or inf\n";
+        if (!converging)
+                std::cout << canonical.name << ": FAILED, error fell slower than spp^" << required_convergence_rate << "\n";
+        return finite && converging && within_baseline;
+}
+
+static bool recordBaselines() {
+        std::ofstream csv(baseline_path);
+        csv << "scene,spp,time_ms,relative_mse\n";
+        bool recorded = true;
+        for (const CanonicalScene &canonical: canonical_scenes)
+                recorded &= recordBaseline(canonical, csv);
+        return recorded;
+}
+
+int main(int argc, char *argv[]) {
+        bool passed = true;
+        std::string mode = argc > 1 ? argv[1] : "";
+        
+        if (mode == "--reference") {
+                uint32_t spp = argc > 2 ? uint32_t(std::stoul(argv[2])) : default_reference_spp;
+                for (const CanonicalScene &canonical: canonical_scenes)
+                        passed &= renderReference(canonical, spp);
+                return passed && recordBaselines() ? 0 : 1;
+        }
+        if (mode == "--baseline")
+                return recordBaselines() ? 0 : 1;
+        
+        bool sorted = mode == "--sorted";
+        int spp_argument = sorted ? 2 : 1;
+        uint32_t max_spp = argc > spp_argument ? uint32_t(std::stoul(argv[spp_argument])) : default_max_spp;
+        std::map<std::string, Baseline> baselines = loadBaselines();
+        for (const CanonicalScene &canonical: canonical_scenes)
+                passed &= measureConvergence(canonical, baselines, max_spp, sorted);
+        return passed ? 0 : 1;
+}
+#else
+int main(int argc, char *argv[]) {
+        std::cout << "The convergence benchmark is only available in SOA builds\n";
+        return 0;
+}
+#endif
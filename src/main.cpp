@@ -8,18 +8,20 @@ struct testt {
 
 int main(int argc, char *argv[]) {
         std::cout << "Start\n";
-        Scene<2400, 2400> scene({-2, 2, 1}, glm::vec3{0, 0, -1}, {0, 1, 0}, 90);
+        Scene<2400, 2400, FrozenShapeSoA> scene({-2, 2, 1}, glm::vec3{0, 0, -1}, {0, 1, 0}, 90);
 
 #ifdef SOA
-        scene.m_shape_soa.insert(Circle(glm::vec3{0.0, 1.5, -1.0}, 1), {200, 100, 100}, 10);
-        scene.m_shape_soa.insert(Plane(glm::vec3{0.0, 1.0, 0.0}, 0), {200, 200, 200}, 0);
-        scene.m_shape_soa.insert(Triangle(glm::vec3{5.0, 0.0, 0.0}, glm::vec3{6.0, 1.0, 0.0}, glm::vec3{4.0, 0.0, 1.0}), {200, 100, 100}, 0);
-        scene.m_shape_soa.insert(Triangle(glm::vec3{2.0, 0.0, 0.0}, glm::vec3{0.0, 1.0, 0.0}, glm::vec3{0.0, 0.0, 1.0}), {100, 200, 100}, 0);
-        scene.m_shape_soa.insert(Triangle(glm::vec3{-2.0, 0.0, 0.0}, glm::vec3{-1.0, 1.0, 0.0}, glm::vec3{-1.0, 0.0, 1.0}), {100, 100, 200}, 0);
-        scene.m_shape_soa.insert(Triangle(glm::vec3{0.0, 0.0, 0.0}, glm::vec3{0.0, 1.0, 0.0}, glm::vec3{0.0, 0.0, 1.0}), {100, 100, 200}, 0);
-        scene.m_shape_soa.insert(Circle(glm::vec3{0.0, 0.0, -1.0}, 0.5), {255, 255, 255}, 10);
-        scene.m_shape_soa.insert(Circle(glm::vec3{-1.0, 0.0, -1.0}, 0.5), {100, 200, 100}, 0);
-        scene.m_shape_soa.insert(Circle(glm::vec3{1.0, 0.0, -1.0}, 0.5), {100, 100, 200}, 0);
+        ShapeSoA shapes;
+        shapes.insert(Circle(glm::vec3{0.0, 1.5, -1.0}, 1), {200, 100, 100}, 10);
+        shapes.insert(Plane(glm::vec3{0.0, 1.0, 0.0}, 0), {200, 200, 200}, 0);
+        shapes.insert(Triangle(glm::vec3{5.0, 0.0, 0.0}, glm::vec3{6.0, 1.0, 0.0}, glm::vec3{4.0, 0.0, 1.0}), {200, 100, 100}, 0);
+        shapes.insert(Triangle(glm::vec3{2.0, 0.0, 0.0}, glm::vec3{0.0, 1.0, 0.0}, glm::vec3{0.0, 0.0, 1.0}), {100, 200, 100}, 0);
+        shapes.insert(Triangle(glm::vec3{-2.0, 0.0, 0.0}, glm::vec3{-1.0, 1.0, 0.0}, glm::vec3{-1.0, 0.0, 1.0}), {100, 100, 200}, 0);
+        shapes.insert(Triangle(glm::vec3{0.0, 0.0, 0.0}, glm::vec3{0.0, 1.0, 0.0}, glm::vec3{0.0, 0.0, 1.0}), {100, 100, 200}, 0);
+        shapes.insert(Circle(glm::vec3{0.0, 0.0, -1.0}, 0.5), {255, 255, 255}, 10);
+        shapes.insert(Circle(glm::vec3{-1.0, 0.0, -1.0}, 0.5), {100, 200, 100}, 0);
+        shapes.insert(Circle(glm::vec3{1.0, 0.0, -1.0}, 0.5), {100, 100, 200}, 0);
+        scene.m_shape_soa = FrozenShapeSoA(shapes);
 #else
         scene.addShape(Circle(glm::vec3{0.0, 1.5, -1.0}, 1), {200, 100, 100}, 10);
         scene.addShape(Plane(glm::vec3{0.0, 1.0, 0.0}, 0), {200, 200, 200}, 0);
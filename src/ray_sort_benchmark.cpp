@@ -0,0 +1,203 @@
+#include "scene.h"
+
+#ifdef SOA
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Renders each configuration tracing every path depth first through traceScanline, then through the sorted breadth
+// first stage of traceRowsSorted at several batch sizes, and reports time, last level cache traffic and texture tile
+// misses of each. The cache counters come from perf_event_open and are reported as unavailable where the kernel does
+// not allow it. The mesh field is the configuration sorting is for: its geometry does not fit the cache, and sorted
+// batches send neighbouring rays through the same meshes one after another.
+//      ray_sort_benchmark [spp]   spp of the main scene, the mesh field renders at a quarter of it
+static constexpr uint32_t benchmark_width = 256;
+static constexpr uint32_t benchmark_height = 256;
+static constexpr int default_spp = 4;
+static constexpr uint32_t batch_rows[] = {1, 16, 64};
+
+typedef Scene<benchmark_width, benchmark_height> BenchmarkScene;
+
+// Last level cache references and misses of this process and every thread it starts while the counters are open
+class CacheCounters {
+public:  // Public Constructors/Destructors/Overloads
+        CacheCounters() {
+                m_references = open(PERF_COUNT_HW_CACHE_REFERENCES);
+                m_misses = open(PERF_COUNT_HW_CACHE_MISSES);
+        }
+        ~CacheCounters() {
+                if (m_references >= 0)
+                        close(m_references);
+                if (m_misses >= 0)
+                        close(m_misses);
+        }
+        CacheCounters(const CacheCounters &) = delete;
+        CacheCounters &operator=(const CacheCounters &) = delete;
+public:  // Public Member Functions
+        [[nodiscard]] bool valid() const noexcept { return m_references >= 0 && m_misses >= 0; }
+        [[nodiscard]] uint64_t references() const noexcept { return read_counter(m_references); }
+        [[nodiscard]] uint64_t misses() const noexcept { return read_counter(m_misses); }
+private: // Private Member Functions
+        static int open(uint64_t config) {
+                perf_event_attr attributes;
+                std::memset(&attributes, 0, sizeof(attributes));
+                attributes.type = PERF_TYPE_HARDWARE;
+                attributes.size = sizeof(attributes);
+                attributes.config = config;
+                attributes.inherit = 1; // count the render threads, they are started after the counters
+                attributes.exclude_kernel = 1;
+                attributes.exclude_hv = 1;
+                return int(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+        }
+
+        static uint64_t read_counter(int fd) {
+                uint64_t value = 0;
+                if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value))
+                        return 0;
+                return value;
+        }
+private: // Private Member Variables
+        int m_references = -1;
+        int m_misses = -1;
+};
+
+// The materials scene of the convergence benchmark with a large texture on the floor and the back triangles, so shading
+// reads more than the handful of cache lines holding the primitives. The texture is the fixed 2048x2048 checkerboard in
+// assets/textures, not assets/test.png, which every run of src/main.cpp overwrites.
+static std::unique_ptr<BenchmarkScene> build_main_scene() {
+        auto scene = std::make_unique<BenchmarkScene>(glm::vec3{-2, 2, 1}, glm::vec3{0, 0, -1}, glm::vec3{0, 1, 0}, 90);
+        MaterialHandle glass = scene->m_material_soa.insert(Dielectric(1.5f));
+        MaterialHandle brushed_metal = scene->m_material_soa.insert(Metal(0.2f));
+        TextureHandle texture = scene->m_texture_cache.load("assets/textures/checker.png");
+
+        scene->m_shape_soa.insert(Circle(glm::vec3{0.0, 1.5, -1.0}, 1), {200, 100, 100}, 10);
+        scene->m_shape_soa.insert(Plane(glm::vec3{0.0, 1.0, 0.0}, 0), {200, 200, 200}, 0, {}, texture);
+        scene->m_shape_soa.insert(Triangle(glm::vec3{5.0, 0.0, 0.0}, glm::vec3{6.0, 1.0, 0.0}, glm::vec3{4.0, 0.0, 1.0}), {200, 100, 100}, 0, {}, texture);
+        scene->m_shape_soa.insert(Triangle(glm::vec3{2.0, 0.0, 0.0}, glm::vec3{0.0, 1.0, 0.0}, glm::vec3{0.0, 0.0, 1.0}), {100, 200, 100}, 0, {}, texture);
+        scene->m_shape_soa.insert(Triangle(glm::vec3{-2.0, 0.0, 0.0}, glm::vec3{-1.0, 1.0, 0.0}, glm::vec3{-1.0, 0.0, 1.0}), {100, 100, 200}, 0, {}, texture);
+        scene->m_shape_soa.insert(Triangle(glm::vec3{0.0, 0.0, 0.0}, glm::vec3{0.0, 1.0, 0.0}, glm::vec3{0.0, 0.0, 1.0}), {100, 100, 200}, 0, {}, texture);
+        scene->m_shape_soa.insert(Circle(glm::vec3{0.0, 0.0, -1.0}, 0.5), {255, 255, 255}, 10);
+        scene->m_shape_soa.insert(Circle(glm::vec3{-1.0, 0.0, -1.0}, 0.5), {100, 200, 100}, 0, glass);
+        scene->m_shape_soa.insert(Circle(glm::vec3{1.0, 0.0, -1.0}, 0.5), {100, 100, 200}, 0, brushed_metal);
+        return scene;
+}
+
+// Latitude/longitude sphere, rings * 2 * rings triangles
+static TriangleMesh sphere_mesh(glm::vec3 center, float radius, uint32_t rings) {
+        uint32_t segments = 2 * rings;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::uvec3> indices;
+        for (uint32_t ring = 0; ring <= rings; ring++) {
+                float theta = std::numbers::pi_v<float> * float(ring) / float(rings);
+                for (uint32_t segment = 0; segment <= segments; segment++) {
+                        float phi = 2.0f * std::numbers::pi_v<float> * float(segment) / float(segments);
+                        positions.push_back(center + radius * glm::vec3{sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)});
+                }
+        }
+        for (uint32_t ring = 0; ring < rings; ring++) {
+                for (uint32_t segment = 0; segment < segments; segment++) {
+                        uint32_t corner = ring * (segments + 1) + segment;
+                        indices.emplace_back(corner, corner + segments + 1, corner + 1);
+                        indices.emplace_back(corner + 1, corner + segments + 1, corner + segments + 2);
+                }
+        }
+        return TriangleMesh(positions, std::move(indices));
+}
+
+// A grid of mesh spheres on a floor seen at a low angle, more vertex data than fits the L2 cache. Every ray that enters a mesh's bounds
+// reads all of its triangles, so whether consecutive rays enter the same meshes decides how much geometry comes from
+// memory rather than cache.
+static std::unique_ptr<BenchmarkScene> build_mesh_field_scene() {
+        auto scene = std::make_unique<BenchmarkScene>(glm::vec3{0, 2.5, 4.5}, glm::vec3{0, 0, 0}, glm::vec3{0, 1, 0}, 60);
+        scene->m_shape_soa.insert(Circle(glm::vec3{1.0, 5.0, 2.0}, 1.0), {255, 255, 255}, 10);
+        scene->m_shape_soa.insert(Plane(glm::vec3{0.0, 1.0, 0.0}, 0), {180, 180, 180}, 0);
+        for (int z = 0; z < 10; z++)
+                for (int x = 0; x < 10; x++)
+                        scene->m_shape_soa.insert(sphere_mesh(glm::vec3{-2.25 + 0.5 * x, 0.2, -2.25 + 0.5 * z}, 0.2f, 32), {200, 120 + 10 * (x % 4), 100}, 0);
+        return scene;
+}
+
+// rows is the number of rows per traceRowsSorted batch, 0 traces every row depth first through traceScanline
+static void render(BenchmarkScene &scene, uint32_t rows, int spp) {
+        size_t misses_before = scene.m_texture_cache.misses();
+        CacheCounters counters;
+        BS::timer timer;
+        {
+                BS::thread_pool pool(12);
+                if (rows == 0) {
+                        for (uint32_t y = 0; y < benchmark_height; y++)
+                                pool.push_task(&BenchmarkScene::traceScanline, &scene, y, recurse_depth, spp);
+                } else {
+                        for (uint32_t y = 0; y < benchmark_height; y += rows)
+                                pool.push_task(&BenchmarkScene::traceRowsSorted, &scene, y, rows, recurse_depth, spp);
+                }
+                pool.wait_for_tasks();
+        }
+        timer.stop();
+        
+        if (rows == 0)
+                std::cout << "  unsorted         : ";
+        else
+                std::cout << "  sorted " << std::setw(3) << rows << " rows  : ";
+        std::cout << timer.ms() << "ms, " << scene.m_texture_cache.misses() - misses_before << " texture tile misses";
+        if (counters.valid()) {
+                uint64_t misses = counters.misses();
+                double seconds = std::max(double(timer.ms()), 1.0) / 1000.0;
+                std::cout << ", LLC references " << counters.references() << ", misses " << misses << ", ~" << double(misses * cache_line_size) / seconds / double(1 << 20) << "MiB/s from memory";
+        } else {
+                std::cout << ", cache counters unavailable";
+        }
+        std::cout << "\n";
+}
+
+static double largest_difference(const BenchmarkScene &a, const BenchmarkScene &b) {
+        double largest = 0.0;
+        for (size_t i = 0; i < a.m_image.data().size(); i++) {
+                glm::vec3 difference = glm::abs(a.m_image.data()[i] - b.m_image.data()[i]);
+                largest = std::max(largest, double(std::max(difference.x, std::max(difference.y, difference.z))));
+        }
+        return largest;
+}
+
+int main(int argc, char *argv[]) {
+        int spp = argc > 1 ? std::stoi(argv[1]) : default_spp;
+        std::cout << benchmark_width << "x" << benchmark_height << "\n";
+        
+        struct BenchmarkConfiguration {
+                const char *name;
+                std::unique_ptr<BenchmarkScene> (*build)();
+                int spp;
+        };
+        const BenchmarkConfiguration configurations[] = {
+                {"main scene", build_main_scene, spp},
+                {"mesh field", build_mesh_field_scene, std::max(spp / 4, 1)},
+        };
+        for (const BenchmarkConfiguration &configuration: configurations) {
+                std::cout << configuration.name << " at " << configuration.spp << "spp\n";
+                auto unsorted = configuration.build();
+                render(*unsorted, 0, configuration.spp);
+                
+                for (uint32_t rows: batch_rows) {
+                        auto sorted = configuration.build();
+                        render(*sorted, rows, configuration.spp);
+                        // Both render the same paths, they only differ by the order contributions are summed in
+                        std::cout << "    largest pixel difference to unsorted " << largest_difference(*unsorted, *sorted) << "\n";
+                        if (rows == batch_rows[0]) {
+                                const RayStatistics &statistics = sorted->m_ray_statistics;
+                                std::cout << "    " << statistics.rays << " rays, hit rate " << statistics.hit_rate() * 100.0 << "%, ";
+                                std::cout << statistics.shadow_rays << " shadow rays, unoccluded " << statistics.unoccluded_rate() * 100.0 << "%\n";
+                        }
+                }
+        }
+        return 0;
+}
+#else
+int main(int argc, char *argv[]) {
+        std::cout << "The ray sort benchmark is only available in SOA builds\n";
+        return 0;
+}
+#endif